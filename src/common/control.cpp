@@ -3,66 +3,220 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "control.h"
+#include "controlcache.h"
+#include "controlstore.h"
 #include "globals.h"
-
+#include "outputidentity.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
 #include <QJsonDocument>
+#include <QSaveFile>
 #include <QStringBuilder>
+#include <QTimer>
+#include <QtConcurrent>
 
 #include <kscreen/config.h>
 
 // clang-format off
-#define retentionString                 QStringLiteral("retention")
 #define nameString                      QStringLiteral("name")
-#define scaleString                     QStringLiteral("scale")
 #define metadataString                  QStringLiteral("metadata")
 #define idString                        QStringLiteral("id")
-#define autorotateString                QStringLiteral("autorotate")
-#define autorotateTabletOnlyString      QStringLiteral("autorotate-tablet-only")
-#define replicateHashString             QStringLiteral("replicate-hash")
-#define replicateNameString             QStringLiteral("replicate-name")
-#define overscanString                  QStringLiteral("overscan")
-#define vrrPolicyString                 QStringLiteral("vrrpolicy")
-#define rgbRangeString                  QStringLiteral("rgbrange")
 #define outputsString                   QStringLiteral("outputs")
+
+// Keys of the typed fields in the control files, indexed by ControlRecord::Field.
+static constexpr const char *s_fieldKeys[] = {
+    "retention",
+    "scale",
+    "autorotate",
+    "autorotate-tablet-only",
+    "replicate-hash",
+    "replicate-name",
+    "overscan",
+    "vrrpolicy",
+    "rgbrange",
+};
+// clang-format on
+static_assert(sizeof(s_fieldKeys) / sizeof(s_fieldKeys[0]) == ControlRecord::FieldCount, "Missing key for a control field");
+
+// clang-format off
+#define sidecarVersionString            QStringLiteral("version")
+#define sidecarSizeString               QStringLiteral("size")
+#define sidecarModifiedString           QStringLiteral("modified")
+#define sidecarHashString               QStringLiteral("hash")
+#define sidecarInfoString               QStringLiteral("info")
 // clang-format on
 
+// Bump when the layout of the sidecar changes, older sidecars are ignored then.
+static const int s_sidecarVersion = 1;
+// A json file modified more recently than this may still change without its size or
+// modification time changing, as far as the file system resolves them. No sidecar is
+// written for it until then.
+static const qint64 s_sidecarSettleInterval = 2000;
+// Delay after the last change notification before watched control files are reloaded.
+static const int s_reloadCompressInterval = 200;
+
 QString Control::s_dirName = QStringLiteral("control/");
+Control::WriteStatistics Control::s_writeStatistics;
+
+static QString sidecarPath(const QString &path)
+{
+    return path % QStringLiteral(".cbor");
+}
+
+// The sidecar holds the parsed info of a control file in CBOR, together with the size and
+// modification time of the json file it was created from. The json file stays authoritative,
+// so external tools keep working on it and any change to it invalidates the sidecar. Sidecars
+// are only refreshed when a json file is parsed, saving a control writes the json file alone.
+static bool readSidecar(const QFileInfo &fileInfo, ControlFile &controlFile)
+{
+    QFile file(sidecarPath(controlFile.path));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QCborMap sidecar = QCborValue::fromCbor(file.readAll()).toMap();
+    if (sidecar.value(sidecarVersionString).toInteger() != s_sidecarVersion
+        || sidecar.value(sidecarSizeString).toInteger() != fileInfo.size()
+        || sidecar.value(sidecarModifiedString).toInteger() != fileInfo.lastModified().toMSecsSinceEpoch()) {
+        return false;
+    }
+    controlFile.hash = sidecar.value(sidecarHashString).toByteArray();
+    controlFile.info = sidecar.value(sidecarInfoString).toMap().toVariantMap();
+    return true;
+}
+
+static void writeSidecar(const ControlFile &controlFile)
+{
+    if (QDateTime::currentMSecsSinceEpoch() - controlFile.modified < s_sidecarSettleInterval) {
+        return;
+    }
+
+    QCborMap sidecar;
+    sidecar[sidecarVersionString] = s_sidecarVersion;
+    sidecar[sidecarSizeString] = controlFile.size;
+    sidecar[sidecarModifiedString] = controlFile.modified;
+    sidecar[sidecarHashString] = controlFile.hash;
+    sidecar[sidecarInfoString] = QCborMap::fromVariantMap(controlFile.info);
+
+    QSaveFile file(sidecarPath(controlFile.path));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    file.write(QCborValue(sidecar).toCbor());
+    file.commit();
+}
 
 Control::Control(QObject *parent)
     : QObject(parent)
 {
 }
 
+// One inotify instance serves all controls.
+QFileSystemWatcher *Control::fileWatcher()
+{
+    static QFileSystemWatcher *watcher = new QFileSystemWatcher(QCoreApplication::instance());
+    return watcher;
+}
+
 void Control::activateWatcher()
 {
     if (m_watcher) {
         return;
     }
 
-    //TODO
-//    m_watcher = new KDirWatch(this);
-//    m_watcher->addFile(filePath());
-//    connect(m_watcher, &KDirWatch::dirty, this, [this]() {
-//        readFile();
-//        Q_EMIT changed();
-//    });
+    m_watcher = fileWatcher();
+    m_reloadCompressor = new QTimer(this);
+    m_reloadCompressor->setSingleShot(true);
+    m_reloadCompressor->setInterval(s_reloadCompressInterval);
+    connect(m_reloadCompressor, &QTimer::timeout, this, &Control::reload);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, &Control::handlePathChanged);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, &Control::handlePathChanged);
+    watchFiles();
 }
 
-KDirWatch *Control::watcher() const
+QFileSystemWatcher *Control::watcher() const
 {
     return m_watcher;
 }
 
+void Control::watchFile(const QString &path)
+{
+    // Watch the directory as well, files are replaced on write and may not exist yet.
+    const QString dir = QFileInfo(path).absolutePath();
+    if (!QDir().mkpath(dir)) {
+        return;
+    }
+    if (!m_watcher->directories().contains(dir)) {
+        m_watcher->addPath(dir);
+    }
+    if (QFile::exists(path) && !m_watcher->files().contains(path)) {
+        m_watcher->addPath(path);
+    }
+}
+
+void Control::watchFiles()
+{
+    watchFile(filePath());
+}
+
+bool Control::isWatchedPath(const QString &path) const
+{
+    const QString file = filePath();
+    return path == file || path == QFileInfo(file).absolutePath();
+}
+
+void Control::handlePathChanged(const QString &path)
+{
+    if (!isWatchedPath(path)) {
+        return;
+    }
+    // Picks up files which were created or replaced since.
+    watchFiles();
+    m_reloadCompressor->start();
+}
+
+void Control::reload()
+{
+    if (reloadFile()) {
+        Q_EMIT changed();
+    }
+}
+
 bool Control::writeFile()
 {
-    const QString path = filePath();
+    storeInfo();
+
+    // The info belongs to the file it was read from, even if the outputs changed since.
+    const QString path = m_filePath.isEmpty() ? filePath() : m_filePath;
     const auto infoMap = constInfo();
 
     if (infoMap.isEmpty()) {
         // Nothing to write. Default control. Remove file if it exists.
         QFile::remove(path);
+        QFile::remove(sidecarPath(path));
+        m_fileHash.clear();
+        m_fileSize = -1;
+        m_fileModified = -1;
+
+        ControlFile controlFile;
+        controlFile.path = path;
+        ControlCache::instance()->insert(controlFile);
+        return true;
+    }
+
+    const QByteArray data = QJsonDocument::fromVariant(infoMap).toJson();
+    const QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+    if (hash == m_fileHash && QFile::exists(path)) {
+        // File is up to date.
+        ++s_writeStatistics.filesSkipped;
         return true;
     }
     if (!QDir().mkpath(dirPath())) {
@@ -70,34 +224,154 @@ bool Control::writeFile()
         return false;
     }
 
-    // write updated data to file
-    QFile file(path);
+    // write updated data to a temporary file and move it over the old one
+    QSaveFile file(path);
     if (!file.open(QIODevice::WriteOnly)) {
         // TODO: logging category?
         //        qCWarning(KSCREEN_COMMON) << "Failed to open config control file for writing! " << file.errorString();
         return false;
     }
-    file.write(QJsonDocument::fromVariant(infoMap).toJson());
+    file.write(data);
+    if (!file.commit()) {
+        qWarning() << "Failed to write control file" << path << file.errorString();
+        return false;
+    }
+    ++s_writeStatistics.filesWritten;
+
+    // Remembering the written file also lets the watcher ignore the echo of this write.
+    const QFileInfo fileInfo(path);
+    ControlFile controlFile;
+    controlFile.path = path;
+    controlFile.hash = hash;
+    controlFile.info = infoMap;
+    controlFile.size = fileInfo.size();
+    controlFile.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    m_filePath = path;
+    m_fileHash = hash;
+    m_fileSize = controlFile.size;
+    m_fileModified = controlFile.modified;
+    ControlCache::instance()->insert(controlFile);
+    ControlStore::instance()->touch(path);
     //    qCDebug(KSCREEN_COMMON) << "Control saved on: " << file.fileName();
     return true;
 }
 
+const Control::WriteStatistics &Control::writeStatistics()
+{
+    return s_writeStatistics;
+}
+
 QString Control::dirPath() const
+{
+    return controlDirPath();
+}
+
+QString Control::controlDirPath()
 {
     return Globals::dirPath() % s_dirName;
 }
 
-void Control::readFile()
+ControlFile Control::parseFile(const QString &path)
 {
-    QFile file(filePath());
+    ControlFile controlFile;
+    controlFile.path = path;
+
+    const QFileInfo fileInfo(path);
+    if (!fileInfo.exists()) {
+        // This is ok. The control file will eventually be created on first write later on.
+        return controlFile;
+    }
+    controlFile.size = fileInfo.size();
+    controlFile.modified = fileInfo.lastModified().toMSecsSinceEpoch();
+    if (readSidecar(fileInfo, controlFile)) {
+        return controlFile;
+    }
+
+    QFile file(path);
     if (file.open(QIODevice::ReadOnly)) {
-        // This might not be reached, bus this is ok. The control file will
-        // eventually be created on first write later on.
+        const QByteArray data = file.readAll();
         QJsonDocument parser;
-        m_info = parser.fromJson(file.readAll()).toVariant().toMap();
+        controlFile.hash = QCryptographicHash::hash(data, QCryptographicHash::Md5);
+        controlFile.info = parser.fromJson(data).toVariant().toMap();
+        // Missing or outdated, e.g. after the file was written by us or edited by another tool.
+        writeSidecar(controlFile);
+    }
+    return controlFile;
+}
+
+bool Control::isFileCurrent(const ControlFile &file)
+{
+    const QFileInfo fileInfo(file.path);
+    const qint64 size = fileInfo.exists() ? fileInfo.size() : -1;
+    const qint64 modified = fileInfo.exists() ? fileInfo.lastModified().toMSecsSinceEpoch() : -1;
+    return size == file.size && modified == file.modified;
+}
+
+void Control::readFile(const ControlFiles &files)
+{
+    const QString path = filePath();
+    auto it = files.constFind(path);
+    if (it != files.constEnd()) {
+        setFile(it.value());
+        return;
+    }
+
+    // Files of layouts seen before are still in the cache.
+    const ControlFiles cached = ControlCache::instance()->files({path});
+    it = cached.constFind(path);
+    setFile(it != cached.constEnd() ? it.value() : parseFile(path));
+}
+
+const QString &Control::loadedFilePath() const
+{
+    return m_filePath;
+}
+
+bool Control::reloadFile()
+{
+    const QString path = filePath();
+    ControlFile current;
+    current.path = path;
+    current.size = m_fileSize;
+    current.modified = m_fileModified;
+    if (isFileCurrent(current)) {
+        // Not touched since we read or wrote it.
+        return false;
+    }
+
+    const ControlFile controlFile = parseFile(path);
+    if (controlFile.hash == m_fileHash) {
+        m_fileSize = controlFile.size;
+        m_fileModified = controlFile.modified;
+        return false;
+    }
+    setFile(controlFile);
+    return true;
+}
+
+void Control::setFile(const ControlFile &controlFile)
+{
+    m_filePath = controlFile.path;
+    m_fileHash = controlFile.hash;
+    m_fileSize = controlFile.size;
+    m_fileModified = controlFile.modified;
+    m_info = controlFile.info;
+    loadInfo();
+
+    ControlCache::instance()->insert(controlFile);
+    if (controlFile.size >= 0) {
+        ControlStore::instance()->touch(controlFile.path);
     }
 }
 
+void Control::loadInfo()
+{
+}
+
+void Control::storeInfo()
+{
+}
+
 QString Control::filePathFromHash(const QString &hash) const
 {
     return dirPath() % hash;
@@ -127,49 +401,334 @@ Control::OutputRetention Control::convertVariantToOutputRetention(QVariant varia
     return OutputRetention::Undefined;
 }
 
-ControlConfig::ControlConfig(KScreen::ConfigPtr config, QObject *parent)
+static bool readField(ControlRecord &record, ControlRecord::Field field, const QVariant &value)
+{
+    switch (field) {
+    case ControlRecord::Retention:
+        record.retention = Control::convertVariantToOutputRetention(value);
+        return true;
+    case ControlRecord::Scale:
+        if (!value.canConvert<qreal>()) {
+            return false;
+        }
+        record.scale = value.toReal();
+        return true;
+    case ControlRecord::AutoRotate:
+        if (!value.canConvert<bool>()) {
+            return false;
+        }
+        record.autoRotate = value.toBool();
+        return true;
+    case ControlRecord::AutoRotateTabletOnly:
+        if (!value.canConvert<bool>()) {
+            return false;
+        }
+        record.autoRotateTabletOnly = value.toBool();
+        return true;
+    case ControlRecord::ReplicateHash:
+        record.replicateHash = value.toString();
+        return true;
+    case ControlRecord::ReplicateName:
+        record.replicateName = value.toString();
+        return true;
+    case ControlRecord::Overscan:
+        if (!value.canConvert<uint>()) {
+            return false;
+        }
+        record.overscan = value.toUInt();
+        return true;
+    case ControlRecord::VrrPolicy:
+        if (!value.canConvert<uint>()) {
+            return false;
+        }
+        record.vrrPolicy = static_cast<KScreen::Output::VrrPolicy>(value.toUInt());
+        return true;
+    case ControlRecord::RgbRange:
+        if (!value.canConvert<uint>()) {
+            return false;
+        }
+        record.rgbRange = static_cast<KScreen::Output::RgbRange>(value.toUInt());
+        return true;
+    case ControlRecord::FieldCount:
+        break;
+    }
+    return false;
+}
+
+static QVariant fieldVariant(const ControlRecord &record, ControlRecord::Field field)
+{
+    switch (field) {
+    case ControlRecord::Retention:
+        return static_cast<int>(record.retention);
+    case ControlRecord::Scale:
+        return record.scale;
+    case ControlRecord::AutoRotate:
+        return record.autoRotate;
+    case ControlRecord::AutoRotateTabletOnly:
+        return record.autoRotateTabletOnly;
+    case ControlRecord::ReplicateHash:
+        return record.replicateHash;
+    case ControlRecord::ReplicateName:
+        return record.replicateName;
+    case ControlRecord::Overscan:
+        return static_cast<uint>(record.overscan);
+    case ControlRecord::VrrPolicy:
+        return static_cast<uint>(record.vrrPolicy);
+    case ControlRecord::RgbRange:
+        return static_cast<uint>(record.rgbRange);
+    case ControlRecord::FieldCount:
+        break;
+    }
+    return QVariant();
+}
+
+ControlRecord ControlRecord::fromVariant(const QVariantMap &map)
+{
+    ControlRecord record;
+    record.extra = map;
+    record.id = record.extra.take(idString).toString();
+    record.name = map[metadataString].toMap()[nameString].toString();
+
+    for (int i = 0; i < FieldCount; ++i) {
+        const auto field = static_cast<Field>(i);
+        const auto it = record.extra.find(QString::fromLatin1(s_fieldKeys[i]));
+        if (it == record.extra.end()) {
+            continue;
+        }
+        // Values which can not be converted stay in extra and are written back unchanged.
+        if (readField(record, field, it.value())) {
+            record.present |= fieldBit(field);
+            record.extra.erase(it);
+        }
+    }
+    return record;
+}
+
+QVariantMap ControlRecord::toVariant() const
+{
+    QVariantMap map = extra;
+    if (!id.isEmpty()) {
+        map[idString] = id;
+    }
+    if (!name.isEmpty()) {
+        QVariantMap metadata = map[metadataString].toMap();
+        metadata[nameString] = name;
+        map[metadataString] = metadata;
+    }
+    for (int i = 0; i < FieldCount; ++i) {
+        const auto field = static_cast<Field>(i);
+        if (has(field)) {
+            map[QString::fromLatin1(s_fieldKeys[i])] = fieldVariant(*this, field);
+        }
+    }
+    return map;
+}
+
+ControlConfig::ControlConfig(KScreen::ConfigPtr config, const ControlFiles &files, QObject *parent)
     : Control(parent)
     , m_config(config)
 {
     //    qDebug() << "Looking for control file:" << config->connectedOutputsHash();
-    readFile();
-
-    // TODO: use a file watcher in case of changes to the control file while
-    //       object exists?
+    readFile(files);
 
     // As global outputs are indexed by a hash of their edid, which is not unique,
     // to be able to tell apart multiple identical outputs, these need special treatment
-    QStringList allIds;
     const auto outputs = config->outputs();
-    allIds.reserve(outputs.count());
-    for (const KScreen::OutputPtr &output : outputs) {
-        const auto outputId = output->hashMd5();
-        if (allIds.contains(outputId) && !m_duplicateOutputIds.contains(outputId)) {
-            m_duplicateOutputIds << outputId;
-        }
-        allIds << outputId;
+    m_outputsControls.reserve(outputs.count());
+    for (const auto &output : outputs) {
+        addOutputControl(output, files);
     }
 
+    // TODO: this is same in Output::readInOutputs of the daemon. Combine?
+
+    connectConfig();
+}
+
+void ControlConfig::setConfig(KScreen::ConfigPtr config)
+{
+    disconnect(m_config.data(), nullptr, this, nullptr);
+    m_config = config;
+
+    // Controls of outputs which are still there with the same identity only follow the new
+    // output objects, the others are dropped and added like on a hotplug.
+    for (int i = m_outputsControls.count() - 1; i >= 0; --i) {
+        auto *control = m_outputsControls.at(i);
+        const auto output = config->output(control->output()->id());
+        if (output && ControlOutput::filePathForOutput(output) == control->filePath()) {
+            m_outputsControlsByIdAndName.remove(qMakePair(control->id(), control->name()));
+            control->setOutput(output);
+            m_outputsControlsByIdAndName.insert(qMakePair(control->id(), control->name()), control);
+            watchConnection(control);
+        } else {
+            removeOutputControl(control->output()->id());
+        }
+    }
+    const auto outputs = config->outputs();
     for (const auto &output : outputs) {
-        m_outputsControls << new ControlOutput(output, this);
+        if (!getOutputControl(OutputIdentity::hash(output), output->name())) {
+            addOutputControl(output);
+        }
     }
 
-    // TODO: this is same in Output::readInOutputs of the daemon. Combine?
+    connectConfig();
+    updateLayout();
+}
 
-    // TODO: connect to outputs added/removed signals and reevaluate duplicate ids
-    //       in case of such a change while object exists?
+void ControlConfig::connectConfig()
+{
+    connect(m_config.data(), &KScreen::Config::outputAdded, this, [this](const KScreen::OutputPtr &output) {
+        addOutputControl(output);
+        updateLayout();
+    });
+    connect(m_config.data(), &KScreen::Config::outputRemoved, this, [this](int outputId) {
+        removeOutputControl(outputId);
+        updateLayout();
+    });
+}
+
+void ControlConfig::watchConnection(ControlOutput *control)
+{
+    // The layout file is named by the set of connected outputs.
+    connect(control->output().data(), &KScreen::Output::isConnectedChanged, control, [this]() {
+        updateLayout();
+    });
+}
+
+bool ControlConfig::updateLayout()
+{
+    if (filePath() == loadedFilePath()) {
+        return false;
+    }
+    // Control files are only written on an explicit write, changes not written yet belong to
+    // the previous layout and are dropped with it.
+    readFile();
+    if (watcher()) {
+        watchFiles();
+    }
+    Q_EMIT changed();
+    return true;
 }
 
-void ControlConfig::activateWatcher()
+void ControlConfig::addOutputControl(const KScreen::OutputPtr &output, const ControlFiles &files)
 {
+    auto *control = new ControlOutput(output, files, this);
+    m_outputsControls << control;
+    ++m_outputIdCounts[control->id()];
+    m_outputsControlsByIdAndName.insert(qMakePair(control->id(), control->name()), control);
+    watchConnection(control);
+
     if (watcher()) {
-        // Watcher was already activated.
+        watchFile(control->filePath());
+    }
+}
+
+void ControlConfig::removeOutputControl(int outputId)
+{
+    for (int i = 0; i < m_outputsControls.count(); ++i) {
+        auto *control = m_outputsControls.at(i);
+        if (control->output()->id() != outputId) {
+            continue;
+        }
+        auto count = m_outputIdCounts.find(control->id());
+        if (count != m_outputIdCounts.end() && --count.value() <= 0) {
+            m_outputIdCounts.erase(count);
+        }
+        const auto key = qMakePair(control->id(), control->name());
+        if (m_outputsControlsByIdAndName.value(key) == control) {
+            m_outputsControlsByIdAndName.remove(key);
+        }
+        m_outputsControls.remove(i);
+        control->deleteLater();
         return;
     }
+}
+
+void ControlConfig::watchFiles()
+{
+    Control::watchFiles();
+    for (auto *output : qAsConst(m_outputsControls)) {
+        watchFile(output->filePath());
+    }
+}
+
+bool ControlConfig::isWatchedPath(const QString &path) const
+{
+    if (Control::isWatchedPath(path)) {
+        return true;
+    }
     for (auto *output : qAsConst(m_outputsControls)) {
-        output->activateWatcher();
-        connect(output, &ControlOutput::changed, this, &ControlConfig::changed);
+        const QString file = output->filePath();
+        if (path == file || path == QFileInfo(file).absolutePath()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ControlConfig::reload()
+{
+    // Only files which were changed by someone else are parsed again, and a burst of
+    // changes over several files ends in a single changed() signal.
+    bool reloaded = reloadFile();
+    for (auto *output : qAsConst(m_outputsControls)) {
+        reloaded |= output->reloadFile();
+    }
+    if (reloaded) {
+        Q_EMIT changed();
+    }
+}
+
+static void addControlFile(ControlFiles &files, const ControlFile &file)
+{
+    files.insert(file.path, file);
+}
+
+namespace
+{
+// Map functor of prefetch(), takes files from the cache and parses the others.
+struct ControlFileReader {
+    using result_type = ControlFile;
+
+    ControlFile operator()(const QString &path) const
+    {
+        const auto it = cached.constFind(path);
+        if (it == cached.constEnd()) {
+            return Control::parseFile(path);
+        }
+        return it.value();
+    }
+
+    ControlFiles cached;
+};
+}
+
+QFuture<ControlFiles> ControlConfig::prefetch(const KScreen::ConfigPtr &config)
+{
+    // Paths are resolved here, only reading and parsing runs in the pool.
+    QStringList paths;
+    paths << filePathForConfig(config);
+    const auto outputs = config->outputs();
+    for (const auto &output : outputs) {
+        paths << ControlOutput::filePathForOutput(output);
     }
+    paths.removeDuplicates();
+
+    ControlFileReader reader;
+    reader.cached = ControlCache::instance()->files(paths);
+    return QtConcurrent::mappedReduced(paths, reader, &addControlFile);
+}
+
+QString ControlConfig::configsDirPath()
+{
+    return controlDirPath() % QStringLiteral("configs/");
+}
+
+QString ControlConfig::filePathForConfig(const KScreen::ConfigPtr &config)
+{
+    if (!config) {
+        return QString();
+    }
+    return configsDirPath() % config->connectedOutputsHash();
 }
 
 QString ControlConfig::dirPath() const
@@ -179,10 +738,7 @@ QString ControlConfig::dirPath() const
 
 QString ControlConfig::filePath() const
 {
-    if (!m_config) {
-        return QString();
-    }
-    return filePathFromHash(m_config->connectedOutputsHash());
+    return filePathForConfig(m_config);
 }
 
 bool ControlConfig::writeFile()
@@ -197,111 +753,134 @@ bool ControlConfig::writeFile()
     return success && Control::writeFile();
 }
 
-bool ControlConfig::infoIsOutput(const QVariantMap &info, const QString &outputId, const QString &outputName) const
+void ControlConfig::loadInfo()
 {
-    const QString outputIdInfo = info[idString].toString();
-    if (outputIdInfo.isEmpty()) {
-        return false;
+    m_outputsRecords.clear();
+    m_outputsById.clear();
+    m_outputsByIdAndName.clear();
+    m_outputsAdded = false;
+
+    const QVariantList outputsInfo = constInfo()[outputsString].toList();
+    m_outputsRecords.reserve(outputsInfo.count());
+    for (const auto &variantInfo : outputsInfo) {
+        const int index = m_outputsRecords.count();
+        m_outputsRecords << ControlRecord::fromVariant(variantInfo.toMap());
+
+        const auto &record = m_outputsRecords.constLast();
+        if (record.id.isEmpty()) {
+            continue;
+        }
+        // Lookups resolve to the first matching record, like the former linear scan did.
+        if (!m_outputsById.contains(record.id)) {
+            m_outputsById.insert(record.id, index);
+        }
+        const auto key = qMakePair(record.id, record.name);
+        if (!m_outputsByIdAndName.contains(key)) {
+            m_outputsByIdAndName.insert(key, index);
+        }
     }
-    if (outputId != outputIdInfo) {
-        return false;
+}
+
+void ControlConfig::storeInfo()
+{
+    bool dirty = m_outputsAdded;
+    for (const auto &record : qAsConst(m_outputsRecords)) {
+        dirty |= record.dirty != 0;
+    }
+    if (!dirty) {
+        // info() still holds what was read.
+        return;
     }
 
-    if (!outputName.isEmpty() && m_duplicateOutputIds.contains(outputId)) {
-        // We may have identical outputs connected, these will have the same id in the config
-        // in order to find the right one, also check the output's name (usually the connector)
-        const auto metadata = info[metadataString].toMap();
-        const auto outputNameInfo = metadata[nameString].toString();
-        if (outputName != outputNameInfo) {
-            // was a duplicate id, but info not for this output
-            return false;
-        }
+    QVariantList outputsInfo;
+    outputsInfo.reserve(m_outputsRecords.count());
+    for (auto &record : m_outputsRecords) {
+        outputsInfo << record.toVariant();
+        record.dirty = 0;
     }
-    return true;
+    info()[outputsString] = outputsInfo;
+    m_outputsAdded = false;
 }
 
-Control::OutputRetention ControlConfig::getOutputRetention(const KScreen::OutputPtr &output) const
+int ControlConfig::outputIndex(const QString &outputId, const QString &outputName) const
 {
-    return getOutputRetention(output->hashMd5(), output->name());
+    if (outputId.isEmpty()) {
+        return -1;
+    }
+    if (!outputName.isEmpty() && m_outputIdCounts.value(outputId) > 1) {
+        // We may have identical outputs connected, these will have the same id in the config
+        // in order to find the right one, also check the output's name (usually the connector)
+        return m_outputsByIdAndName.value(qMakePair(outputId, outputName), -1);
+    }
+    return m_outputsById.value(outputId, -1);
 }
 
-Control::OutputRetention ControlConfig::getOutputRetention(const QString &outputId, const QString &outputName) const
+ControlRecord &ControlConfig::outputRecord(const QString &outputId, const QString &outputName)
 {
-    const QVariantList outputsInfo = getOutputs();
-    for (const auto &variantInfo : outputsInfo) {
-        const QVariantMap info = variantInfo.toMap();
-        if (!infoIsOutput(info, outputId, outputName)) {
-            continue;
-        }
-        return convertVariantToOutputRetention(info[retentionString]);
+    const int index = outputIndex(outputId, outputName);
+    if (index >= 0) {
+        return m_outputsRecords[index];
     }
-    // info for output not found
-    return OutputRetention::Undefined;
+
+    // no entry yet, create one
+    const int newIndex = m_outputsRecords.count();
+    ControlRecord record;
+    record.id = outputId;
+    record.name = outputName;
+    m_outputsRecords << record;
+    m_outputsAdded = true;
+
+    if (!m_outputsById.contains(outputId)) {
+        m_outputsById.insert(outputId, newIndex);
+    }
+    const auto key = qMakePair(outputId, outputName);
+    if (!m_outputsByIdAndName.contains(key)) {
+        m_outputsByIdAndName.insert(key, newIndex);
+    }
+    return m_outputsRecords[newIndex];
 }
 
-static QVariantMap metadata(const QString &outputName)
+Control::OutputRetention ControlConfig::getOutputRetention(const KScreen::OutputPtr &output) const
 {
-    QVariantMap metadata;
-    metadata[nameString] = outputName;
-    return metadata;
+    return getOutputRetention(OutputIdentity::hash(output), output->name());
 }
 
-QVariantMap createOutputInfo(const QString &outputId, const QString &outputName)
+Control::OutputRetention ControlConfig::getOutputRetention(const QString &outputId, const QString &outputName) const
 {
-    QVariantMap outputInfo;
-    outputInfo[idString] = outputId;
-    outputInfo[metadataString] = metadata(outputName);
-    return outputInfo;
+    const int index = outputIndex(outputId, outputName);
+    if (index < 0) {
+        // info for output not found
+        return OutputRetention::Undefined;
+    }
+    return m_outputsRecords.at(index).retention;
 }
 
 void ControlConfig::setOutputRetention(const KScreen::OutputPtr &output, OutputRetention value)
 {
-    setOutputRetention(output->hashMd5(), output->name(), value);
+    setOutputRetention(OutputIdentity::hash(output), output->name(), value);
 }
 
 void ControlConfig::setOutputRetention(const QString &outputId, const QString &outputName, OutputRetention value)
 {
-    QList<QVariant>::iterator it;
-    QVariantList outputsInfo = getOutputs();
+    outputRecord(outputId, outputName).setValue(ControlFields::retention, value);
+}
 
-    for (it = outputsInfo.begin(); it != outputsInfo.end(); ++it) {
-        QVariantMap outputInfo = (*it).toMap();
-        if (!infoIsOutput(outputInfo, outputId, outputName)) {
-            continue;
-        }
-        outputInfo[retentionString] = (int)value;
-        *it = outputInfo;
-        setOutputs(outputsInfo);
-        return;
+void ControlConfig::setOutputRetention(const KScreen::OutputList &outputs, OutputRetention value)
+{
+    m_outputsRecords.reserve(m_outputsRecords.count() + outputs.count());
+    for (const auto &output : outputs) {
+        outputRecord(OutputIdentity::hash(output), output->name()).setValue(ControlFields::retention, value);
     }
-    // no entry yet, create one
-    auto outputInfo = createOutputInfo(outputId, outputName);
-    outputInfo[retentionString] = (int)value;
-
-    outputsInfo << outputInfo;
-    setOutputs(outputsInfo);
 }
 
 template<typename T, typename F>
-T ControlConfig::get(const KScreen::OutputPtr &output, const QString &name, F globalRetentionFunc, T defaultValue) const
+T ControlConfig::get(const KScreen::OutputPtr &output, const ControlField<T> &field, F globalRetentionFunc) const
 {
-    const auto &outputId = output->hashMd5();
+    const auto &outputId = OutputIdentity::hash(output);
     const auto &outputName = output->name();
-    const auto retention = getOutputRetention(outputId, outputName);
-    if (retention == OutputRetention::Individual) {
-        const QVariantList outputsInfo = getOutputs();
-        for (const auto &variantInfo : outputsInfo) {
-            const QVariantMap info = variantInfo.toMap();
-            if (!infoIsOutput(info, outputId, outputName)) {
-                continue;
-            }
-            const auto val = info[name];
-            if (val.template canConvert<T>()) {
-                return val.template value<T>();
-            } else {
-                return defaultValue;
-            }
-        }
+    const int index = outputIndex(outputId, outputName);
+    if (index >= 0 && m_outputsRecords.at(index).retention == OutputRetention::Individual) {
+        return m_outputsRecords.at(index).value(field);
     }
     // Retention is global or info for output not in config control file.
     if (auto *outputControl = getOutputControl(outputId, outputName)) {
@@ -309,36 +888,17 @@ T ControlConfig::get(const KScreen::OutputPtr &output, const QString &name, F gl
     }
 
     // Info for output not found.
-    return defaultValue;
+    static const ControlRecord defaults;
+    return defaults.value(field);
 }
 
-template<typename T, typename F, typename V>
-void ControlConfig::set(const KScreen::OutputPtr &output, const QString &name, F globalRetentionFunc, V value)
+template<typename T, typename F>
+void ControlConfig::set(const KScreen::OutputPtr &output, const ControlField<T> &field, F globalRetentionFunc, const T &value)
 {
-    const auto &outputId = output->hashMd5();
+    const auto &outputId = OutputIdentity::hash(output);
     const auto &outputName = output->name();
-    QList<QVariant>::iterator it;
-    QVariantList outputsInfo = getOutputs();
-
-    for (it = outputsInfo.begin(); it != outputsInfo.end(); ++it) {
-        QVariantMap outputInfo = (*it).toMap();
-        if (!infoIsOutput(outputInfo, outputId, outputName)) {
-            continue;
-        }
-        outputInfo[name] = static_cast<T>(value);
-        *it = outputInfo;
-        setOutputs(outputsInfo);
-        if (auto *control = getOutputControl(outputId, outputName)) {
-            (control->*globalRetentionFunc)(value);
-        }
-        return;
-    }
-    // no entry yet, create one
-    auto outputInfo = createOutputInfo(outputId, outputName);
-    outputInfo[name] = static_cast<T>(value);
 
-    outputsInfo << outputInfo;
-    setOutputs(outputsInfo);
+    outputRecord(outputId, outputName).setValue(field, value);
     if (auto *control = getOutputControl(outputId, outputName)) {
         (control->*globalRetentionFunc)(value);
     }
@@ -346,153 +906,130 @@ void ControlConfig::set(const KScreen::OutputPtr &output, const QString &name, F
 
 qreal ControlConfig::getScale(const KScreen::OutputPtr &output) const
 {
-    return get(output, scaleString, &ControlOutput::getScale, -1.0);
+    return get(output, ControlFields::scale, &ControlOutput::getScale);
 }
 
 void ControlConfig::setScale(const KScreen::OutputPtr &output, qreal value)
 {
-    set<qreal>(output, scaleString, &ControlOutput::setScale, value);
+    set(output, ControlFields::scale, &ControlOutput::setScale, value);
 }
 
 bool ControlConfig::getAutoRotate(const KScreen::OutputPtr &output) const
 {
-    return get(output, autorotateString, &ControlOutput::getAutoRotate, true);
+    return get(output, ControlFields::autoRotate, &ControlOutput::getAutoRotate);
 }
 
 void ControlConfig::setAutoRotate(const KScreen::OutputPtr &output, bool value)
 {
-    set<bool>(output, autorotateString, &ControlOutput::setAutoRotate, value);
+    set(output, ControlFields::autoRotate, &ControlOutput::setAutoRotate, value);
 }
 
 bool ControlConfig::getAutoRotateOnlyInTabletMode(const KScreen::OutputPtr &output) const
 {
-    return get(output, autorotateTabletOnlyString, &ControlOutput::getAutoRotateOnlyInTabletMode, true);
+    return get(output, ControlFields::autoRotateTabletOnly, &ControlOutput::getAutoRotateOnlyInTabletMode);
 }
 
 void ControlConfig::setAutoRotateOnlyInTabletMode(const KScreen::OutputPtr &output, bool value)
 {
-    set<bool>(output, autorotateTabletOnlyString, &ControlOutput::setAutoRotateOnlyInTabletMode, value);
+    set(output, ControlFields::autoRotateTabletOnly, &ControlOutput::setAutoRotateOnlyInTabletMode, value);
 }
 
 KScreen::OutputPtr ControlConfig::getReplicationSource(const KScreen::OutputPtr &output) const
 {
-    const QVariantList outputsInfo = getOutputs();
-    for (const auto &variantInfo : outputsInfo) {
-        const QVariantMap info = variantInfo.toMap();
-        if (!infoIsOutput(info, output->hashMd5(), output->name())) {
-            continue;
-        }
-        const QString sourceHash = info[replicateHashString].toString();
-        const QString sourceName = info[replicateNameString].toString();
+    const int index = outputIndex(OutputIdentity::hash(output), output->name());
+    if (index < 0) {
+        // Info for output not found.
+        return nullptr;
+    }
+    const auto &record = m_outputsRecords.at(index);
+    const QString &sourceHash = record.replicateHash;
+    const QString &sourceName = record.replicateName;
 
-        if (sourceHash.isEmpty() && sourceName.isEmpty()) {
-            // Common case when the replication source has been unset.
-            return nullptr;
-        }
+    if (sourceHash.isEmpty() && sourceName.isEmpty()) {
+        // Common case when the replication source has been unset.
+        return nullptr;
+    }
 
-        const auto outputs = m_config->outputs();
-        for (const auto &output : outputs) {
-            if (output->hashMd5() == sourceHash && output->name() == sourceName) {
-                return output;
-            }
+    const auto outputs = m_config->outputs();
+    for (const auto &output : outputs) {
+        if (output->name() != sourceName) {
+            continue;
+        }
+        if (OutputIdentity::hash(output) == sourceHash) {
+            return output;
         }
-        // No match.
-        return nullptr;
     }
-    // Info for output not found.
+    // No match.
     return nullptr;
 }
 
 void ControlConfig::setReplicationSource(const KScreen::OutputPtr &output, const KScreen::OutputPtr &source)
 {
-    QList<QVariant>::iterator it;
-    QVariantList outputsInfo = getOutputs();
-    const QString sourceHash = source ? source->hashMd5() : QString();
+    const QString sourceHash = source ? OutputIdentity::hash(source) : QString();
     const QString sourceName = source ? source->name() : QString();
 
-    for (it = outputsInfo.begin(); it != outputsInfo.end(); ++it) {
-        QVariantMap outputInfo = (*it).toMap();
-        if (!infoIsOutput(outputInfo, output->hashMd5(), output->name())) {
-            continue;
-        }
-        outputInfo[replicateHashString] = sourceHash;
-        outputInfo[replicateNameString] = sourceName;
-        *it = outputInfo;
-        setOutputs(outputsInfo);
-        // TODO: shall we set this information also as new global value (like with auto-rotate)?
-        return;
-    }
-    // no entry yet, create one
-    auto outputInfo = createOutputInfo(output->hashMd5(), output->name());
-    outputInfo[replicateHashString] = sourceHash;
-    outputInfo[replicateNameString] = sourceName;
-
-    outputsInfo << outputInfo;
-    setOutputs(outputsInfo);
+    auto &record = outputRecord(OutputIdentity::hash(output), output->name());
+    record.setValue(ControlFields::replicateHash, sourceHash);
+    record.setValue(ControlFields::replicateName, sourceName);
     // TODO: shall we set this information also as new global value (like with auto-rotate)?
 }
 
 uint32_t ControlConfig::getOverscan(const KScreen::OutputPtr &output) const
 {
-    return get(output, overscanString, &ControlOutput::overscan, 0);
+    return get(output, ControlFields::overscan, &ControlOutput::overscan);
 }
 
 void ControlConfig::setOverscan(const KScreen::OutputPtr &output, const uint32_t value)
 {
-    set<uint32_t>(output, overscanString, &ControlOutput::setOverscan, value);
+    set(output, ControlFields::overscan, &ControlOutput::setOverscan, value);
 }
 
 KScreen::Output::VrrPolicy ControlConfig::getVrrPolicy(const KScreen::OutputPtr &output) const
 {
-    return get(output, vrrPolicyString, &ControlOutput::vrrPolicy, KScreen::Output::VrrPolicy::Automatic);
+    return get(output, ControlFields::vrrPolicy, &ControlOutput::vrrPolicy);
 }
 
 void ControlConfig::setVrrPolicy(const KScreen::OutputPtr &output, const KScreen::Output::VrrPolicy value)
 {
-    set<uint32_t>(output, vrrPolicyString, &ControlOutput::setVrrPolicy, value);
+    set(output, ControlFields::vrrPolicy, &ControlOutput::setVrrPolicy, value);
 }
 
 KScreen::Output::RgbRange ControlConfig::getRgbRange(const KScreen::OutputPtr &output) const
 {
-    return get(output, rgbRangeString, &ControlOutput::rgbRange, KScreen::Output::RgbRange::Automatic);
+    return get(output, ControlFields::rgbRange, &ControlOutput::rgbRange);
 }
 
 void ControlConfig::setRgbRange(const KScreen::OutputPtr &output, const KScreen::Output::RgbRange value)
 {
-    set<uint32_t>(output, rgbRangeString, &ControlOutput::setRgbRange, value);
+    set(output, ControlFields::rgbRange, &ControlOutput::setRgbRange, value);
 }
 
-QVariantList ControlConfig::getOutputs() const
+ControlOutput *ControlConfig::getOutputControl(const QString &outputId, const QString &outputName) const
 {
-    return constInfo()[outputsString].toList();
+    return m_outputsControlsByIdAndName.value(qMakePair(outputId, outputName));
 }
 
-void ControlConfig::setOutputs(QVariantList outputsInfo)
+ControlOutput::ControlOutput(KScreen::OutputPtr output, const ControlFiles &files, QObject *parent)
+    : Control(parent)
+    , m_output(output)
 {
-    auto &infoMap = info();
-    infoMap[outputsString] = outputsInfo;
+    readFile(files);
 }
 
-ControlOutput *ControlConfig::getOutputControl(const QString &outputId, const QString &outputName) const
+const KScreen::OutputPtr &ControlOutput::output() const
 {
-    for (auto *control : m_outputsControls) {
-        if (control->id() == outputId && control->name() == outputName) {
-            return control;
-        }
-    }
-    return nullptr;
+    return m_output;
 }
 
-ControlOutput::ControlOutput(KScreen::OutputPtr output, QObject *parent)
-    : Control(parent)
-    , m_output(output)
+void ControlOutput::setOutput(const KScreen::OutputPtr &output)
 {
-    readFile();
+    Q_ASSERT(filePathForOutput(output) == filePath());
+    m_output = output;
 }
 
 QString ControlOutput::id() const
 {
-    return m_output->hashMd5();
+    return OutputIdentity::hash(m_output);
 }
 
 QString ControlOutput::name() const
@@ -505,109 +1042,105 @@ QString ControlOutput::dirPath() const
     return Control::dirPath() % QStringLiteral("outputs/");
 }
 
-QString ControlOutput::filePath() const
+QString ControlOutput::outputsDirPath()
+{
+    return controlDirPath() % QStringLiteral("outputs/");
+}
+
+QString ControlOutput::filePathForOutput(const KScreen::OutputPtr &output)
 {
-    if (!m_output) {
+    if (!output) {
         return QString();
     }
-    return filePathFromHash(m_output->hashMd5());
+    return outputsDirPath() % OutputIdentity::hash(output);
+}
+
+QString ControlOutput::filePath() const
+{
+    return filePathForOutput(m_output);
+}
+
+void ControlOutput::loadInfo()
+{
+    m_record = ControlRecord::fromVariant(constInfo());
+}
+
+void ControlOutput::storeInfo()
+{
+    if (!m_record.dirty) {
+        return;
+    }
+    info() = m_record.toVariant();
+    m_record.dirty = 0;
+}
+
+template<typename T>
+void ControlOutput::set(const ControlField<T> &field, const T &value)
+{
+    if (!m_record.present && m_record.id.isEmpty() && m_record.extra.isEmpty()) {
+        // Default control, identify the output before adding the first value.
+        m_record.id = OutputIdentity::hash(m_output);
+        m_record.name = m_output->name();
+    }
+    m_record.setValue(field, value);
 }
 
 qreal ControlOutput::getScale() const
 {
-    const auto val = constInfo()[scaleString];
-    return val.canConvert<qreal>() ? val.toReal() : -1;
+    return m_record.scale;
 }
 
 void ControlOutput::setScale(qreal value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[scaleString] = value;
+    set(ControlFields::scale, value);
 }
 
 bool ControlOutput::getAutoRotate() const
 {
-    const auto val = constInfo()[autorotateString];
-    return !val.canConvert<bool>() || val.toBool();
+    return m_record.autoRotate;
 }
 
 void ControlOutput::setAutoRotate(bool value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[autorotateString] = value;
+    set(ControlFields::autoRotate, value);
 }
 
 bool ControlOutput::getAutoRotateOnlyInTabletMode() const
 {
-    const auto val = constInfo()[autorotateTabletOnlyString];
-    return !val.canConvert<bool>() || val.toBool();
+    return m_record.autoRotateTabletOnly;
 }
 
 void ControlOutput::setAutoRotateOnlyInTabletMode(bool value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[autorotateTabletOnlyString] = value;
+    set(ControlFields::autoRotateTabletOnly, value);
 }
 
 uint32_t ControlOutput::overscan() const
 {
-    const auto val = constInfo()[overscanString];
-    if (val.canConvert<uint>()) {
-        return val.toUInt();
-    }
-    return 0;
+    return m_record.overscan;
 }
 
 void ControlOutput::setOverscan(uint32_t value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[overscanString] = static_cast<uint>(value);
+    set(ControlFields::overscan, value);
 }
 
 KScreen::Output::VrrPolicy ControlOutput::vrrPolicy() const
 {
-    const auto val = constInfo()[vrrPolicyString];
-    if (val.canConvert<uint>()) {
-        return static_cast<KScreen::Output::VrrPolicy>(val.toUInt());
-    }
-    return KScreen::Output::VrrPolicy::Automatic;
+    return m_record.vrrPolicy;
 }
 
 void ControlOutput::setVrrPolicy(KScreen::Output::VrrPolicy value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[vrrPolicyString] = static_cast<uint>(value);
+    set(ControlFields::vrrPolicy, value);
 }
 
 KScreen::Output::RgbRange ControlOutput::rgbRange() const
 {
-    const auto val = constInfo()[rgbRangeString];
-    if (val.canConvert<uint>()) {
-        return static_cast<KScreen::Output::RgbRange>(val.toUInt());
-    }
-    return KScreen::Output::RgbRange::Automatic;
+    return m_record.rgbRange;
 }
 
 void ControlOutput::setRgbRange(KScreen::Output::RgbRange value)
 {
-    auto &infoMap = info();
-    if (infoMap.isEmpty()) {
-        infoMap = createOutputInfo(m_output->hashMd5(), m_output->name());
-    }
-    infoMap[rgbRangeString] = static_cast<uint>(value);
+    set(ControlFields::rgbRange, value);
 }
@@ -8,11 +8,28 @@
 #include <kscreen/output.h>
 #include <kscreen/types.h>
 
+#include <QFuture>
+#include <QHash>
 #include <QObject>
+#include <QPair>
 #include <QVariantMap>
 #include <QVector>
 
-class KDirWatch;
+class QFileSystemWatcher;
+class QTimer;
+
+// Contents of a control file, read and parsed ahead of building the controls.
+struct ControlFile
+{
+    QString path;
+    // Md5 of the json data the info was parsed from.
+    QByteArray hash;
+    QVariantMap info;
+    // Size and modification time in msecs since epoch of the json file, -1 if it does not exist.
+    qint64 size = -1;
+    qint64 modified = -1;
+};
+using ControlFiles = QHash<QString, ControlFile>;
 
 class Control : public QObject
 {
@@ -32,6 +49,27 @@ public:
     virtual bool writeFile();
     virtual void activateWatcher();
 
+    static OutputRetention convertVariantToOutputRetention(QVariant variant);
+
+    struct WriteStatistics {
+        quint64 filesWritten = 0;
+        quint64 filesSkipped = 0;
+    };
+    static const WriteStatistics &writeStatistics();
+
+    // Can be called from any thread. Uses the binary sidecar of the file when it is up to date.
+    static ControlFile parseFile(const QString &path);
+    // Can be called from any thread. Whether the size and modification time on disk still match.
+    static bool isFileCurrent(const ControlFile &file);
+
+    // Reads the file again if it differs from what was last read or written, returns whether it did.
+    bool reloadFile();
+    // Path of the file the info was read from or last written to.
+    const QString &loadedFilePath() const;
+
+    // Shared by all controls, each of them filters the paths it is interested in.
+    static QFileSystemWatcher *fileWatcher();
+
 Q_SIGNALS:
     void changed();
 
@@ -39,31 +77,160 @@ protected:
     virtual QString dirPath() const;
     virtual QString filePath() const = 0;
     QString filePathFromHash(const QString &hash) const;
-    void readFile();
+    static QString controlDirPath();
+    // Takes the file from files if it was prefetched, or from the ControlCache if it is
+    // up to date there, otherwise reads it from disk.
+    void readFile(const ControlFiles &files = ControlFiles());
     QVariantMap &info();
     const QVariantMap &constInfo() const;
-    KDirWatch *watcher() const;
+    QFileSystemWatcher *watcher() const;
 
-    static OutputRetention convertVariantToOutputRetention(QVariant variant);
+    // Converts info() to the typed records after reading, and back before writing.
+    virtual void loadInfo();
+    virtual void storeInfo();
+
+    // Adds the files of this control and their directories to the watcher.
+    virtual void watchFiles();
+    virtual bool isWatchedPath(const QString &path) const;
+    // Called once after a burst of changes to the watched paths.
+    virtual void reload();
+    void watchFile(const QString &path);
 
 private:
+    void setFile(const ControlFile &controlFile);
+    void handlePathChanged(const QString &path);
+
     static QString s_dirName;
+    static WriteStatistics s_writeStatistics;
+    QString m_filePath;
     QVariantMap m_info;
-    KDirWatch *m_watcher = nullptr;
+    // Hash, size and modification time of the file as last read or written, to skip
+    // writes which would not change it and reloads which would not change anything.
+    QByteArray m_fileHash;
+    qint64 m_fileSize = -1;
+    qint64 m_fileModified = -1;
+    QFileSystemWatcher *m_watcher = nullptr;
+    QTimer *m_reloadCompressor = nullptr;
 };
 
+template<typename T>
+struct ControlField;
+
+/**
+ * Typed settings of one output as stored in a control file. Only the load and save
+ * boundary converts from and to QVariant, get and set work on plain members.
+ */
+struct ControlRecord
+{
+    enum Field {
+        Retention,
+        Scale,
+        AutoRotate,
+        AutoRotateTabletOnly,
+        ReplicateHash,
+        ReplicateName,
+        Overscan,
+        VrrPolicy,
+        RgbRange,
+        FieldCount
+    };
+    using Fields = quint16;
+    static_assert(FieldCount <= 16, "Fields can not hold all field bits");
+
+    static constexpr Fields fieldBit(Field field)
+    {
+        return Fields(1u << field);
+    }
+
+    static ControlRecord fromVariant(const QVariantMap &map);
+    QVariantMap toVariant() const;
+
+    bool has(Field field) const
+    {
+        return present & fieldBit(field);
+    }
+
+    template<typename T>
+    const T &value(const ControlField<T> &field) const
+    {
+        return this->*(field.member);
+    }
+
+    template<typename T>
+    void setValue(const ControlField<T> &field, const T &value)
+    {
+        this->*(field.member) = value;
+        present |= fieldBit(field.field);
+        dirty |= fieldBit(field.field);
+    }
+
+    QString id;
+    QString name;
+
+    // Members hold the default value of a field as long as it is not present.
+    Control::OutputRetention retention = Control::OutputRetention::Undefined;
+    qreal scale = -1;
+    bool autoRotate = true;
+    bool autoRotateTabletOnly = true;
+    QString replicateHash;
+    QString replicateName;
+    uint32_t overscan = 0;
+    KScreen::Output::VrrPolicy vrrPolicy = KScreen::Output::VrrPolicy::Automatic;
+    KScreen::Output::RgbRange rgbRange = KScreen::Output::RgbRange::Automatic;
+
+    // Fields stored in the file, and fields changed since the last load or save.
+    Fields present = 0;
+    Fields dirty = 0;
+
+    // Entries without a typed field, kept so they survive a save.
+    QVariantMap extra;
+};
+
+template<typename T>
+struct ControlField
+{
+    ControlRecord::Field field;
+    T ControlRecord::*member;
+};
+
+namespace ControlFields
+{
+// clang-format off
+constexpr ControlField<Control::OutputRetention>    retention               {ControlRecord::Retention,              &ControlRecord::retention};
+constexpr ControlField<qreal>                       scale                   {ControlRecord::Scale,                  &ControlRecord::scale};
+constexpr ControlField<bool>                        autoRotate              {ControlRecord::AutoRotate,             &ControlRecord::autoRotate};
+constexpr ControlField<bool>                        autoRotateTabletOnly    {ControlRecord::AutoRotateTabletOnly,   &ControlRecord::autoRotateTabletOnly};
+constexpr ControlField<QString>                     replicateHash           {ControlRecord::ReplicateHash,          &ControlRecord::replicateHash};
+constexpr ControlField<QString>                     replicateName           {ControlRecord::ReplicateName,          &ControlRecord::replicateName};
+constexpr ControlField<uint32_t>                    overscan                {ControlRecord::Overscan,               &ControlRecord::overscan};
+constexpr ControlField<KScreen::Output::VrrPolicy>  vrrPolicy               {ControlRecord::VrrPolicy,              &ControlRecord::vrrPolicy};
+constexpr ControlField<KScreen::Output::RgbRange>   rgbRange                {ControlRecord::RgbRange,               &ControlRecord::rgbRange};
+// clang-format on
+}
+
 class ControlOutput;
 
 class ControlConfig : public Control
 {
     Q_OBJECT
 public:
-    explicit ControlConfig(KScreen::ConfigPtr config, QObject *parent = nullptr);
+    explicit ControlConfig(KScreen::ConfigPtr config, const ControlFiles &files = ControlFiles(), QObject *parent = nullptr);
+
+    // Reads and parses the control files of config and its outputs concurrently in the global thread pool.
+    // Files found in the ControlCache are taken from there instead.
+    static QFuture<ControlFiles> prefetch(const KScreen::ConfigPtr &config);
+    static QString configsDirPath();
+    static QString filePathForConfig(const KScreen::ConfigPtr &config);
+    // Follows a newer config, keeping the controls of the outputs which are still there. The
+    // layout file is switched if the connected outputs differ from those it was read for.
+    void setConfig(KScreen::ConfigPtr config);
 
     OutputRetention getOutputRetention(const KScreen::OutputPtr &output) const;
     OutputRetention getOutputRetention(const QString &outputId, const QString &outputName) const;
     void setOutputRetention(const KScreen::OutputPtr &output, OutputRetention value);
     void setOutputRetention(const QString &outputId, const QString &outputName, OutputRetention value);
+    // Sets the retention of all outputs in one pass.
+    void setOutputRetention(const KScreen::OutputList &outputs, OutputRetention value);
 
     qreal getScale(const KScreen::OutputPtr &output) const;
     void setScale(const KScreen::OutputPtr &output, qreal value);
@@ -90,30 +257,58 @@ public:
     QString filePath() const override;
 
     bool writeFile() override;
-    void activateWatcher() override;
+
+protected:
+    void loadInfo() override;
+    void storeInfo() override;
+    void watchFiles() override;
+    bool isWatchedPath(const QString &path) const override;
+    void reload() override;
 
 private:
-    QVariantList getOutputs() const;
-    void setOutputs(QVariantList outputsInfo);
-    bool infoIsOutput(const QVariantMap &info, const QString &outputId, const QString &outputName) const;
+    void addOutputControl(const KScreen::OutputPtr &output, const ControlFiles &files = ControlFiles());
+    void removeOutputControl(int outputId);
+    void connectConfig();
+    void watchConnection(ControlOutput *control);
+    // Switches to the file of the current set of connected outputs if it is another one than
+    // the loaded, returns whether it did.
+    bool updateLayout();
+    int outputIndex(const QString &outputId, const QString &outputName) const;
+    ControlRecord &outputRecord(const QString &outputId, const QString &outputName);
     ControlOutput *getOutputControl(const QString &outputId, const QString &outputName) const;
 
     template<typename T, typename F>
-    T get(const KScreen::OutputPtr &output, const QString &name, F globalRetentionFunc, T defaultValue) const;
-    template<typename T, typename F, typename V>
-    void set(const KScreen::OutputPtr &output, const QString &name, F globalRetentionFunc, V value);
+    T get(const KScreen::OutputPtr &output, const ControlField<T> &field, F globalRetentionFunc) const;
+    template<typename T, typename F>
+    void set(const KScreen::OutputPtr &output, const ControlField<T> &field, F globalRetentionFunc, const T &value);
 
     KScreen::ConfigPtr m_config;
-    QStringList m_duplicateOutputIds;
+    // Number of outputs by edid hash, more than one means the connector name is needed to tell them apart.
+    QHash<QString, int> m_outputIdCounts;
     QVector<ControlOutput *> m_outputsControls;
+    // The controls of m_outputsControls by output id and connector name.
+    QHash<QPair<QString, QString>, ControlOutput *> m_outputsControlsByIdAndName;
+
+    // Per-output records of the control file.
+    QVector<ControlRecord> m_outputsRecords;
+    bool m_outputsAdded = false;
+    // Positions in m_outputsRecords of the first record by output id, and by output id and connector name.
+    QHash<QString, int> m_outputsById;
+    QHash<QPair<QString, QString>, int> m_outputsByIdAndName;
 };
 
 class ControlOutput : public Control
 {
     Q_OBJECT
 public:
-    explicit ControlOutput(KScreen::OutputPtr output, QObject *parent = nullptr);
+    explicit ControlOutput(KScreen::OutputPtr output, const ControlFiles &files = ControlFiles(), QObject *parent = nullptr);
+
+    static QString outputsDirPath();
+    static QString filePathForOutput(const KScreen::OutputPtr &output);
 
+    const KScreen::OutputPtr &output() const;
+    // Rebinds to another object of the same output, e.g. from a reloaded config.
+    void setOutput(const KScreen::OutputPtr &output);
     QString id() const;
     QString name() const;
 
@@ -140,8 +335,16 @@ public:
     QString dirPath() const override;
     QString filePath() const override;
 
+protected:
+    void loadInfo() override;
+    void storeInfo() override;
+
 private:
+    template<typename T>
+    void set(const ControlField<T> &field, const T &value);
+
     KScreen::OutputPtr m_output;
+    ControlRecord m_record;
 };
 
 #endif // COMMON_CONTROL_H
@@ -0,0 +1,138 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "controlcache.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+// Number of layouts read ahead on startup, and number of files kept in memory.
+static const int s_prewarmLayouts = 8;
+static const int s_maxFiles = 64;
+
+ControlCache *ControlCache::instance()
+{
+    static ControlCache *cache = new ControlCache(QCoreApplication::instance());
+    return cache;
+}
+
+ControlCache::ControlCache(QObject *parent)
+    : QObject(parent)
+{
+    m_files.setMaxCost(s_maxFiles);
+
+    // Changes of files outside the current layout are only noticed through their directory.
+    auto *watcher = Control::fileWatcher();
+    const QStringList dirs = { ControlConfig::configsDirPath(), ControlOutput::outputsDirPath() };
+    for (const auto &dir : dirs) {
+        const QString path = QDir::cleanPath(dir);
+        if (QDir().mkpath(path) && !watcher->directories().contains(path)) {
+            watcher->addPath(path);
+        }
+    }
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, &ControlCache::handleDirectoryChanged);
+}
+
+QString ControlCache::dirOf(const QString &path)
+{
+    return QFileInfo(path).absolutePath();
+}
+
+void ControlCache::handleDirectoryChanged(const QString &path)
+{
+    const QString dir = QDir::cleanPath(path);
+    ++m_generations[dir];
+
+    // Our own writes update their entry and sidecars are not cached, only the entries of this
+    // directory whose file changed on disk are dropped.
+    const auto paths = m_files.keys();
+    for (const auto &filePath : paths) {
+        if (dirOf(filePath) == dir && !Control::isFileCurrent(*m_files.object(filePath))) {
+            m_files.remove(filePath);
+        }
+    }
+}
+
+ControlFiles ControlCache::files(const QStringList &paths) const
+{
+    ControlFiles files;
+    for (const auto &path : paths) {
+        if (const auto *file = m_files.object(path)) {
+            files.insert(path, *file);
+        }
+    }
+    return files;
+}
+
+void ControlCache::insert(const ControlFile &file)
+{
+    if (file.path.isEmpty()) {
+        return;
+    }
+    m_files.insert(file.path, new ControlFile(file));
+}
+
+ControlFiles ControlCache::readRecentLayouts(int count)
+{
+    ControlFiles files;
+
+    QDir dir(ControlConfig::configsDirPath());
+    const auto entries = dir.entryInfoList(QDir::Files, QDir::Time);
+    int layouts = 0;
+    for (const auto &entry : entries) {
+        if (layouts >= count) {
+            break;
+        }
+        if (!entry.suffix().isEmpty()) {
+            // Sidecars and temporary files.
+            continue;
+        }
+        const auto configFile = Control::parseFile(entry.absoluteFilePath());
+        files.insert(configFile.path, configFile);
+        ++layouts;
+
+        // Outputs of the layout, as far as the config control file knows them.
+        const auto outputs = configFile.info[QStringLiteral("outputs")].toList();
+        for (const auto &output : outputs) {
+            const QString id = output.toMap()[QStringLiteral("id")].toString();
+            const QString path = ControlOutput::outputsDirPath() + id;
+            if (!id.isEmpty() && !files.contains(path)) {
+                files.insert(path, Control::parseFile(path));
+            }
+        }
+    }
+    return files;
+}
+
+void ControlCache::prewarm()
+{
+    if (m_prewarmed) {
+        return;
+    }
+    m_prewarmed = true;
+
+    // Changes of files while they are read are only seen through their directory.
+    const auto generations = m_generations;
+    auto *watcher = new QFutureWatcher<ControlFiles>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, generations]() {
+        watcher->deleteLater();
+        const auto files = watcher->result();
+        for (const auto &file : files) {
+            // Files loaded in the meantime are at least as new.
+            if (m_files.contains(file.path)) {
+                continue;
+            }
+            const QString dir = dirOf(file.path);
+            if (generations.value(dir) != m_generations.value(dir) && !Control::isFileCurrent(file)) {
+                continue;
+            }
+            insert(file);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&ControlCache::readRecentLayouts, s_prewarmLayouts));
+}
@@ -0,0 +1,47 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef COMMON_CONTROLCACHE_H
+#define COMMON_CONTROLCACHE_H
+
+#include "control.h"
+
+#include <QCache>
+#include <QHash>
+#include <QObject>
+
+/**
+ * Bounded LRU of parsed control files of the layouts seen recently, so switching back to a
+ * known set of outputs does not read or parse anything. Entries are checked against the disk
+ * when their directory changes, and dropped once their file changed. Must be used from the
+ * main thread.
+ */
+class ControlCache : public QObject
+{
+    Q_OBJECT
+public:
+    static ControlCache *instance();
+
+    // @returns the cached files among paths
+    ControlFiles files(const QStringList &paths) const;
+    void insert(const ControlFile &file);
+
+    // Reads the most recently used layouts of the configs directory in the background.
+    void prewarm();
+
+private:
+    explicit ControlCache(QObject *parent = nullptr);
+
+    static ControlFiles readRecentLayouts(int count);
+    static QString dirOf(const QString &path);
+    void handleDirectoryChanged(const QString &path);
+
+    QCache<QString, ControlFile> m_files;
+    // Number of changes seen by directory, files read in the background are checked against
+    // the disk if theirs changed meanwhile.
+    QHash<QString, quint64> m_generations;
+    bool m_prewarmed = false;
+};
+
+#endif // COMMON_CONTROLCACHE_H
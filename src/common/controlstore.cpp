@@ -0,0 +1,225 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "controlstore.h"
+#include "control.h"
+#include "globals.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStringBuilder>
+#include <QTimer>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+static const int s_defaultMaxEntries = 64;
+static const qint64 s_defaultMaxBytes = 4 * 1024 * 1024;
+static const int s_indexWriteCompressInterval = 5000;
+static const int s_compactionDelay = 60 * 1000;
+
+ControlStore *ControlStore::instance()
+{
+    static ControlStore *store = new ControlStore(QCoreApplication::instance());
+    return store;
+}
+
+ControlStore::ControlStore(QObject *parent)
+    : QObject(parent)
+    , m_maxEntries(s_defaultMaxEntries)
+    , m_maxBytes(s_defaultMaxBytes)
+    , m_sessionStart(QDateTime::currentMSecsSinceEpoch())
+    , m_indexWriteCompressor(new QTimer(this))
+    , m_compactionTimer(new QTimer(this))
+{
+    m_indexWriteCompressor->setSingleShot(true);
+    m_indexWriteCompressor->setInterval(s_indexWriteCompressInterval);
+    connect(m_indexWriteCompressor, &QTimer::timeout, this, &ControlStore::writeIndex);
+
+    m_compactionTimer->setSingleShot(true);
+    m_compactionTimer->setInterval(s_compactionDelay);
+    connect(m_compactionTimer, &QTimer::timeout, this, &ControlStore::compact);
+
+    readIndex();
+}
+
+QString ControlStore::indexPath()
+{
+    return Globals::dirPath() % QStringLiteral("control/index");
+}
+
+void ControlStore::readIndex()
+{
+    QFile file(indexPath());
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    const QJsonObject index = QJsonDocument::fromJson(file.readAll()).object();
+    for (auto it = index.constBegin(); it != index.constEnd(); ++it) {
+        m_lastUsed.insert(it.key(), qint64(it.value().toDouble()));
+    }
+}
+
+void ControlStore::writeIndex()
+{
+    m_indexWriteCompressor->stop();
+
+    QJsonObject index;
+    for (auto it = m_lastUsed.constBegin(); it != m_lastUsed.constEnd(); ++it) {
+        index.insert(it.key(), double(it.value()));
+    }
+
+    QSaveFile file(indexPath());
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to open control store index for writing! " << file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(index).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qWarning() << "Failed to write control store index! " << file.errorString();
+    }
+}
+
+void ControlStore::setLimits(int maxEntries, qint64 maxBytes)
+{
+    m_maxEntries = maxEntries > 0 ? maxEntries : s_defaultMaxEntries;
+    m_maxBytes = maxBytes > 0 ? maxBytes : s_defaultMaxBytes;
+}
+
+void ControlStore::touch(const QString &path)
+{
+    if (path.isEmpty()) {
+        return;
+    }
+    const bool added = !m_lastUsed.contains(path);
+    m_lastUsed.insert(path, QDateTime::currentMSecsSinceEpoch());
+    m_indexWriteCompressor->start();
+    if (added) {
+        // A new file may push the store over its budget.
+        scheduleCompaction();
+    }
+}
+
+void ControlStore::scheduleCompaction()
+{
+    m_compactionTimer->start();
+}
+
+ControlStore::Compaction ControlStore::collect(QHash<QString, qint64> lastUsed, int maxEntries, qint64 maxBytes, qint64 protectedSince)
+{
+    struct Entry {
+        QString dirPath;
+        QString path;
+        qint64 lastUsed;
+        qint64 bytes;
+    };
+
+    Compaction result;
+    QVector<Entry> entries;
+    QHash<QString, int> dirEntries;
+    QHash<QString, qint64> present;
+
+    const QStringList dirs = { ControlConfig::configsDirPath(), ControlOutput::outputsDirPath() };
+    for (const auto &dirPath : dirs) {
+        const auto infos = QDir(dirPath).entryInfoList(QDir::Files);
+        QHash<QString, qint64> sidecarBytes;
+        for (const auto &info : infos) {
+            if (info.suffix() == QLatin1String("cbor")) {
+                sidecarBytes.insert(info.absolutePath() % QLatin1Char('/') % info.completeBaseName(), info.size());
+            }
+        }
+        for (const auto &info : infos) {
+            if (!info.suffix().isEmpty()) {
+                continue;
+            }
+            const QString path = dirPath % info.fileName();
+            // Files missing from the index, e.g. from before it existed, count as used when last modified.
+            const qint64 used = lastUsed.value(path, info.lastModified().toMSecsSinceEpoch());
+            const qint64 bytes = info.size() + sidecarBytes.value(info.absoluteFilePath());
+            entries.append({ dirPath, path, used, bytes });
+            present.insert(path, used);
+            ++dirEntries[dirPath];
+            result.bytes += bytes;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.lastUsed < b.lastUsed;
+    });
+
+    for (const auto &entry : qAsConst(entries)) {
+        if (dirEntries.value(entry.dirPath) <= maxEntries && result.bytes <= maxBytes) {
+            continue;
+        }
+        if (entry.lastUsed >= protectedSince) {
+            continue;
+        }
+        QFile::remove(entry.path % QStringLiteral(".cbor"));
+        if (!QFile::remove(entry.path)) {
+            continue;
+        }
+        --dirEntries[entry.dirPath];
+        result.bytes -= entry.bytes;
+        present.remove(entry.path);
+        result.evicted << entry.path;
+    }
+
+    // Entries of files which are gone are dropped from the index.
+    result.lastUsed = present;
+    result.entries = present.count();
+    return result;
+}
+
+void ControlStore::compact()
+{
+    if (m_compacting) {
+        scheduleCompaction();
+        return;
+    }
+    m_compacting = true;
+
+    auto *watcher = new QFutureWatcher<Compaction>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        m_compacting = false;
+
+        const Compaction result = watcher->result();
+        // Keep what was touched in the meantime, it is newer than anything collect() saw.
+        for (auto it = result.lastUsed.constBegin(); it != result.lastUsed.constEnd(); ++it) {
+            auto &used = m_lastUsed[it.key()];
+            used = qMax(used, it.value());
+        }
+        for (auto it = m_lastUsed.begin(); it != m_lastUsed.end();) {
+            if (!result.lastUsed.contains(it.key()) && it.value() < m_sessionStart) {
+                it = m_lastUsed.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        m_entries = result.entries;
+        m_bytes = result.bytes;
+        m_evicted += result.evicted.count();
+        if (!result.evicted.isEmpty()) {
+            qInfo() << "Evicted" << result.evicted.count() << "control files, store holds" << m_entries << "files in" << m_bytes << "bytes";
+        }
+        writeIndex();
+    });
+    watcher->setFuture(QtConcurrent::run(&ControlStore::collect, m_lastUsed, m_maxEntries, m_maxBytes, m_sessionStart));
+}
+
+QVariantMap ControlStore::statistics() const
+{
+    return {
+        { QStringLiteral("ControlStoreEntries"), m_entries },
+        { QStringLiteral("ControlStoreBytes"), m_bytes },
+        { QStringLiteral("ControlStoreEvicted"), m_evicted },
+    };
+}
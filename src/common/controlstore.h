@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef COMMON_CONTROLSTORE_H
+#define COMMON_CONTROLSTORE_H
+
+#include <QHash>
+#include <QObject>
+#include <QVariantMap>
+
+class QTimer;
+
+/**
+ * Keeps the control directory bounded. Remembers when each control file was last used and
+ * evicts the least recently used ones once there are more than maxEntries files in configs/
+ * or outputs/, or their total size exceeds maxBytes. Files used by this process are never
+ * evicted. Must be used from the main thread.
+ */
+class ControlStore : public QObject
+{
+    Q_OBJECT
+public:
+    static ControlStore *instance();
+
+    void setLimits(int maxEntries, qint64 maxBytes);
+
+    // Records that the control file at path was read or written.
+    void touch(const QString &path);
+
+    // Collects garbage in the background a while after the last call.
+    void scheduleCompaction();
+
+    QVariantMap statistics() const;
+
+private:
+    explicit ControlStore(QObject *parent = nullptr);
+
+    struct Compaction {
+        QHash<QString, qint64> lastUsed;
+        QStringList evicted;
+        int entries = 0;
+        qint64 bytes = 0;
+    };
+    static Compaction collect(QHash<QString, qint64> lastUsed, int maxEntries, qint64 maxBytes, qint64 protectedSince);
+
+    void compact();
+    void readIndex();
+    void writeIndex();
+    static QString indexPath();
+
+    QHash<QString, qint64> m_lastUsed;
+    int m_maxEntries;
+    qint64 m_maxBytes;
+    qint64 m_sessionStart;
+    QTimer *m_indexWriteCompressor;
+    QTimer *m_compactionTimer;
+    bool m_compacting = false;
+
+    int m_entries = -1;
+    qint64 m_bytes = -1;
+    quint64 m_evicted = 0;
+};
+
+#endif // COMMON_CONTROLSTORE_H
@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "outputidentity.h"
+
+#include <QHash>
+
+#include <kscreen/edid.h>
+
+namespace
+{
+struct Identity {
+    QByteArray edid;
+    QString name;
+    QString hash;
+    uint token = 0;
+};
+
+struct IdentityCache {
+    QHash<int, Identity> identities;
+    QHash<QString, uint> tokens;
+};
+}
+
+Q_GLOBAL_STATIC(IdentityCache, s_cache)
+
+static uint insertToken(const QString &hash)
+{
+    auto it = s_cache->tokens.find(hash);
+    if (it == s_cache->tokens.end()) {
+        it = s_cache->tokens.insert(hash, uint(s_cache->tokens.size()) + 1);
+    }
+    return it.value();
+}
+
+static QByteArray edidData(const KScreen::Output *output)
+{
+    const auto *edid = output->edid();
+    return edid && edid->isValid() ? edid->rawData() : QByteArray();
+}
+
+static const Identity &identity(const KScreen::Output *output)
+{
+    auto &identity = s_cache->identities[output->id()];
+    const QByteArray edid = edidData(output);
+    // Without a valid EDID the hash is derived from the connector name.
+    if (identity.hash.isEmpty() || identity.edid != edid || (edid.isEmpty() && identity.name != output->name())) {
+        identity.edid = edid;
+        identity.name = output->name();
+        identity.hash = output->hashMd5();
+        identity.token = insertToken(identity.hash);
+    }
+    return identity;
+}
+
+namespace OutputIdentity
+{
+
+QString hash(const KScreen::Output *output)
+{
+    return identity(output).hash;
+}
+
+QString hash(const KScreen::OutputPtr &output)
+{
+    return hash(output.data());
+}
+
+uint token(const KScreen::Output *output)
+{
+    return identity(output).token;
+}
+
+uint token(const KScreen::OutputPtr &output)
+{
+    return token(output.data());
+}
+
+void forget(int outputId)
+{
+    s_cache->identities.remove(outputId);
+}
+}
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef COMMON_OUTPUTIDENTITY_H
+#define COMMON_OUTPUTIDENTITY_H
+
+#include <QString>
+
+#include <kscreen/output.h>
+#include <kscreen/types.h>
+
+/**
+ * Caches KScreen::Output::hashMd5() by output id. The hash is only computed again
+ * when the EDID of the output changes. Must be used from the main thread.
+ */
+namespace OutputIdentity
+{
+QString hash(const KScreen::Output *output);
+QString hash(const KScreen::OutputPtr &output);
+/**
+ * A small integer for the hash of the output, valid within this process. Outputs
+ * with equal hashes get equal tokens, 0 is never used.
+ */
+uint token(const KScreen::Output *output);
+uint token(const KScreen::OutputPtr &output);
+// Drops the cached identity of a removed output.
+void forget(int outputId);
+}
+
+#endif // COMMON_OUTPUTIDENTITY_H
@@ -3,46 +3,185 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "config.h"
+#include "layoutnormalizer.h"
+#include "../common/outputidentity.h"
 
 #include <kscreen/configmonitor.h>
-#include <kscreen/getconfigoperation.h>
 #include <kscreen/output.h>
+#include <kscreen/setconfigoperation.h>
 
+#include <QElapsedTimer>
+#include <QFutureWatcher>
 #include <QGuiApplication>
 #include <QRect>
 
 using namespace KScreen;
 using namespace dde::display;
 
+// Delay after the last writeControl() call before the control files are flushed.
+static const int s_writeCompressInterval = 500;
+
 ConfigHandler::ConfigHandler(QObject *parent)
     : QObject(parent)
+    , m_diff(new ConfigDiff(this))
+    , m_writeCompressor(new QTimer(this))
+{
+    connect(m_diff, &ConfigDiff::changed, this, &ConfigHandler::checkNeedsSave);
+
+    m_writeCompressor->setSingleShot(true);
+    m_writeCompressor->setInterval(s_writeCompressInterval);
+    connect(m_writeCompressor, &QTimer::timeout, this, &ConfigHandler::flushControl);
+    // The handler is not destroyed on exit, a write still pending then is flushed here.
+    connect(qApp, &QCoreApplication::aboutToQuit, this, &ConfigHandler::flushPendingControl);
+}
+
+ConfigHandler::~ConfigHandler()
 {
+    flushPendingControl();
+}
+
+void ConfigHandler::flushPendingControl()
+{
+    if (m_writeCompressor->isActive()) {
+        flushControl();
+    }
 }
 
 void ConfigHandler::setConfig(KScreen::ConfigPtr config)
 {
+    if (m_config && m_control) {
+        updateConfig(config);
+        return;
+    }
     m_config = config;
-    m_initialConfig = m_config->clone();
-    m_initialControl.reset(new ControlConfig(m_initialConfig));
+    m_initialConfig = ConfigSnapshot::capture(m_config);
 
     KScreen::ConfigMonitor::instance()->addConfig(m_config);
-    m_control.reset(new ControlConfig(config));
 
-    const auto outputs = config->outputs();
+    // Control files are read off the main thread.
+    auto *watcher = new QFutureWatcher<ControlFiles>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, config]() {
+        watcher->deleteLater();
+        if (config != m_config) {
+            // Superseded by a newer config.
+            return;
+        }
+        initControls(watcher->result());
+    });
+    watcher->setFuture(ControlConfig::prefetch(m_config));
+}
+
+void ConfigHandler::initControls(const ControlFiles &files)
+{
+    m_control.reset(new ControlConfig(m_config, files));
+
+    // Pick up edits of the control files done by other tools or sessions.
+    m_control->activateWatcher();
+    connect(m_control.get(), &Control::changed, this, [this]() {
+        invalidateRetention();
+        Q_EMIT retentionChanged();
+        updateControlChanges();
+        checkNeedsSave();
+        Q_EMIT changed();
+    });
+
+    const auto outputs = m_config->outputs();
     qInfo() << "MY_TEST" << outputs;
     for (const KScreen::OutputPtr &output : outputs) {
         initOutput(output);
     }
     m_lastNormalizedScreenSize = screenSize();
+    m_screenNormalized = true;
+
+    for (auto &snapshot : m_initialConfig.outputs) {
+        if (const auto output = m_config->output(snapshot.id)) {
+            captureControl(snapshot, output);
+        }
+    }
+    m_diff->setConfigs(m_config, m_initialConfig);
+    updateControlChanges();
 
-    // TODO: put this into m_initialControl
     m_initialRetention = getRetention();
     Q_EMIT retentionChanged();
 
-    connect(m_config.data(), &KScreen::Config::outputAdded, this, [this]() {
+    connectConfig();
+    Q_EMIT configLoaded();
+}
+
+void ConfigHandler::updateConfig(KScreen::ConfigPtr config)
+{
+    const KScreen::ConfigPtr oldConfig = m_config;
+    disconnect(oldConfig.data(), nullptr, this, nullptr);
+    const auto oldOutputs = oldConfig->outputs();
+    for (const auto &output : oldOutputs) {
+        disconnect(output.data(), nullptr, this, nullptr);
+    }
+    KScreen::ConfigMonitor::instance()->removeConfig(oldConfig);
+
+    // Changes staged on the old objects are gone with them.
+    endTransaction();
+    m_outputRects.clear();
+    m_screenRight = 0;
+    m_screenBottom = 0;
+    invalidateRetention();
+
+    // The old config object was already updated in place by the config monitor, the layout is
+    // compared against the one the controls were read for.
+    if (ControlConfig::filePathForConfig(config) != m_control->loadedFilePath()) {
+        // Another set of connected outputs, start over from its control files. The states kept
+        // so far belong to the old layout and can not be restored onto the new one.
+        flushPendingControl();
+        m_history.clear();
+        m_previousConfig = ConfigSnapshot();
+        m_applyRequest.base = ConfigSnapshot();
+        m_applyRequest.history = ConfigHistory();
+        m_applyPendingRequest.base = ConfigSnapshot();
+        m_applyPendingRequest.history = ConfigHistory();
+        m_control.reset();
+        setConfig(config);
+        return;
+    }
+
+    m_config = config;
+    KScreen::ConfigMonitor::instance()->addConfig(m_config);
+    m_control->setConfig(m_config);
+    ++m_configUpdatesInPlace;
+
+    // Same layout, the initial state, history and normalization state stay valid. Only
+    // outputs whose id is new get an initial state.
+    const auto outputs = m_config->outputs();
+    for (const KScreen::OutputPtr &output : outputs) {
+        initOutput(output);
+        if (!m_initialConfig.output(output->id())) {
+            OutputSnapshot snapshot = OutputSnapshot::capture(output);
+            captureControl(snapshot, output);
+            m_initialConfig.outputs << snapshot;
+        }
+    }
+    m_diff->setConfigs(m_config, m_initialConfig);
+    updateControlChanges();
+    checkScreenNormalization();
+    checkNeedsSave();
+
+    connectConfig();
+    Q_EMIT configLoaded();
+}
+
+void ConfigHandler::connectConfig()
+{
+    connect(m_config.data(), &KScreen::Config::outputAdded, this, [this](const KScreen::OutputPtr &output) {
+        invalidateRetention();
+        initOutput(output);
+        checkScreenNormalization();
         Q_EMIT outputConnect(true);
     });
-    connect(m_config.data(), &KScreen::Config::outputRemoved, this, [this]() {
+    connect(m_config.data(), &KScreen::Config::outputRemoved, this, [this](int outputId) {
+        invalidateRetention();
+        OutputIdentity::forget(outputId);
+        Q_EMIT removeMonitor(outputId);
+        if (setOutputRect(outputId, QRect())) {
+            checkScreenNormalization();
+        }
         Q_EMIT outputConnect(false);
     });
     connect(m_config.data(), &KScreen::Config::primaryOutputChanged, this, &ConfigHandler::primaryOutputChanged);
@@ -50,16 +189,15 @@ void ConfigHandler::setConfig(KScreen::ConfigPtr config)
 
 void ConfigHandler::resetScale(const KScreen::OutputPtr &output)
 {
+    if (!m_control) {
+        return;
+    }
     // Load scale control (either not set, same or windowing system does not transmit scale).
     const qreal scale = m_control->getScale(output);
     if (scale > 0) {
         output->setScale(scale);
-        const auto outputs = m_initialConfig->outputs();
-        for (auto initialOutput : outputs) {
-            if (initialOutput->id() == output->id()) {
-                initialOutput->setScale(scale);
-                break;
-            }
+        if (auto *initialOutput = m_initialConfig.output(output->id())) {
+            initialOutput->scale = scale;
         }
     }
 }
@@ -72,121 +210,424 @@ void ConfigHandler::initOutput(const KScreen::OutputPtr &output)
         resetScale(output);
         Q_EMIT addMonitor(output);
     }
+    trackOutputGeometry(output);
     connect(output.data(), &KScreen::Output::isConnectedChanged, this, [this, output]() {
+        // The retention is aggregated over the connected outputs.
+        invalidateRetention();
+        // A disconnected output keeps its monitor, so a reconnect does not register it again.
+        if (output->isConnected()) {
+            Q_EMIT addMonitor(output);
+        } else {
+            Q_EMIT monitorChanged(output);
+        }
         Q_EMIT outputConnect(output->isConnected());
     });
+    connect(output.data(), &KScreen::Output::outputChanged, this, [this, output]() {
+        Q_EMIT monitorChanged(output);
+    });
 }
 
 void ConfigHandler::updateInitialData()
 {
-    m_previousConfig = m_initialConfig->clone();
+    m_previousConfig = m_initialConfig;
     m_initialRetention = getRetention();
-    connect(new GetConfigOperation(), &GetConfigOperation::finished, this, [this](ConfigOperation *op) {
-        if (op->hasError()) {
-            return;
-        }
-        m_initialConfig = qobject_cast<GetConfigOperation *>(op)->config();
-        const auto outputs = m_config->outputs();
-        for (const auto &output : outputs) {
-            resetScale(output);
+
+    const auto outputs = m_config->outputs();
+    for (const auto &output : outputs) {
+        resetScale(output);
+    }
+    m_initialConfig = captureConfig();
+    m_diff->setConfigs(m_config, m_initialConfig);
+    updateControlChanges();
+    checkNeedsSave();
+}
+
+void ConfigHandler::revertConfig()
+{
+    if (m_previousConfig.isNull()) {
+        // Nothing was saved before.
+        return;
+    }
+    // Goes back in place, the outputs and the signal connections to them stay the same.
+    m_previousConfig.restore(m_config);
+    updateControlChanges();
+}
+
+void ConfigHandler::captureControl(OutputSnapshot &snapshot, const KScreen::OutputPtr &output) const
+{
+    if (!m_control) {
+        return;
+    }
+    snapshot.autoRotate = m_control->getAutoRotate(output);
+    snapshot.autoRotateTabletOnly = m_control->getAutoRotateOnlyInTabletMode(output);
+}
+
+ConfigSnapshot ConfigHandler::captureConfig() const
+{
+    ConfigSnapshot snapshot = ConfigSnapshot::capture(m_config);
+    for (auto &outputSnapshot : snapshot.outputs) {
+        if (const auto output = m_config->output(outputSnapshot.id)) {
+            captureControl(outputSnapshot, output);
         }
-        m_initialControl.reset(new ControlConfig(m_initialConfig));
-        checkNeedsSave();
-    });
+    }
+    return snapshot;
+}
+
+void ConfigHandler::updateControlChanges(const KScreen::OutputPtr &output)
+{
+    const auto *initial = m_initialConfig.output(output->id());
+    if (!m_control || !initial) {
+        return;
+    }
+    ConfigDiff::Fields changes = 0;
+    if (m_control->getAutoRotate(output) != initial->autoRotate) {
+        changes |= ConfigDiff::fieldBit(ConfigDiff::AutoRotate);
+    }
+    if (m_control->getAutoRotateOnlyInTabletMode(output) != initial->autoRotateTabletOnly) {
+        changes |= ConfigDiff::fieldBit(ConfigDiff::AutoRotateTabletOnly);
+    }
+    m_diff->setControlChanges(output, changes);
+}
+
+void ConfigHandler::updateControlChanges()
+{
+    const auto outputs = m_config->outputs();
+    for (const auto &output : outputs) {
+        updateControlChanges(output);
+    }
 }
 
 bool ConfigHandler::shouldTestNewSettings()
 {
-    return checkSaveandTestCommon(false);
+    return m_diff->needsTest();
 }
 
 void ConfigHandler::checkNeedsSave()
 {
-    if (m_config->supportedFeatures() & KScreen::Config::Feature::PrimaryDisplay) {
-        if (m_config->primaryOutput() && m_initialConfig->primaryOutput()) {
-            if (m_config->primaryOutput()->hashMd5() != m_initialConfig->primaryOutput()->hashMd5()) {
-                Q_EMIT needsSaveChecked(true);
-                return;
-            }
-        } else if ((bool)m_config->primaryOutput() != (bool)m_initialConfig->primaryOutput()) {
-            Q_EMIT needsSaveChecked(true);
-            return;
+    if (!m_control) {
+        // Controls are still loading.
+        return;
+    }
+
+    bool needsSave = m_diff->needsSave() || m_initialRetention != getRetention();
+    if (!needsSave && m_config->supportedFeatures() & KScreen::Config::Feature::PrimaryDisplay) {
+        const auto *initialPrimary = m_initialConfig.primaryOutput();
+        if (m_config->primaryOutput() && initialPrimary) {
+            needsSave = OutputIdentity::token(m_config->primaryOutput()) != initialPrimary->token;
+        } else {
+            needsSave = (bool)m_config->primaryOutput() != (bool)initialPrimary;
         }
     }
 
-    if (m_initialRetention != getRetention()) {
-        Q_EMIT needsSaveChecked(true);
+    if (needsSave == m_needsSave) {
         return;
     }
-    Q_EMIT needsSaveChecked(checkSaveandTestCommon(true));
+    m_needsSave = needsSave;
+    Q_EMIT needsSaveChecked(needsSave);
 }
 
-bool ConfigHandler::checkSaveandTestCommon(bool isSaveCheck)
+void ConfigHandler::beginTransaction()
 {
-    const auto outputs = m_config->connectedOutputs();
-    for (const auto &output : outputs) {
-        const QString hash = output->hashMd5();
-        const auto configs = m_initialConfig->outputs();
-        for (const auto &config : configs) {
-            if (hash != config->hashMd5()) {
-                continue;
-            }
-
-            if (output->isEnabled() != config->isEnabled()) {
-                return true;
-            }
-
-            // clang-format off
-            if (output->isEnabled()) {
-                bool scaleChanged = false;
-                if (isSaveCheck || m_config->supportedFeatures() & KScreen::Config::Feature::PerOutputScaling) {
-                     scaleChanged = output->scale() != config->scale();
-                }
-                if ( output->currentModeId() != config->currentModeId()
-                    || output->pos() != config->pos()
-                    || scaleChanged
-                    || output->rotation() != config->rotation()
-                    || output->replicationSource() != config->replicationSource()
-                    || autoRotate(output) != m_initialControl->getAutoRotate(output)
-                    || autoRotateOnlyInTabletMode(output) != m_initialControl->getAutoRotateOnlyInTabletMode(output)
-                    || output->overscan() != config->overscan()
-                    || output->vrrPolicy() != config->vrrPolicy()
-                    || output->rgbRange() != config->rgbRange()) {
-                        return true;
-                    }
-            }
-            // clang-format on
-        }
+    if (m_transactionActive) {
+        return;
     }
-    return false;
+    m_transactionBase = captureConfig();
+    m_transactionActive = true;
+    Q_EMIT pendingChangesChanged(true);
 }
 
-QSize ConfigHandler::screenSize() const
+void ConfigHandler::endTransaction()
 {
-    int width = 0, height = 0;
-    QSize size;
+    if (!m_transactionActive) {
+        return;
+    }
+    m_transactionBase = ConfigSnapshot();
+    m_transactionActive = false;
+    Q_EMIT pendingChangesChanged(false);
+}
 
-    const auto connectedOutputs = m_config->connectedOutputs();
-    for (const auto &output : connectedOutputs) {
-        if (!output->isPositionable()) {
-            continue;
+void ConfigHandler::setOutputEnabled(const KScreen::OutputPtr &output, bool enabled)
+{
+    if (!m_config || output->isEnabled() == enabled) {
+        return;
+    }
+    beginTransaction();
+    output->setEnabled(enabled);
+}
+
+void ConfigHandler::setOutputMode(const KScreen::OutputPtr &output, const QString &modeId)
+{
+    if (!m_config || output->currentModeId() == modeId) {
+        return;
+    }
+    beginTransaction();
+    output->setCurrentModeId(modeId);
+}
+
+void ConfigHandler::setOutputPosition(const KScreen::OutputPtr &output, const QPoint &pos)
+{
+    if (!m_config || output->pos() == pos) {
+        return;
+    }
+    beginTransaction();
+    output->setPos(pos);
+}
+
+void ConfigHandler::setOutputRotation(const KScreen::OutputPtr &output, KScreen::Output::Rotation rotation)
+{
+    if (!m_config || output->rotation() == rotation) {
+        return;
+    }
+    beginTransaction();
+    output->setRotation(rotation);
+}
+
+void ConfigHandler::setPrimaryOutput(const KScreen::OutputPtr &output)
+{
+    if (!m_config || m_config->primaryOutput() == output) {
+        return;
+    }
+    beginTransaction();
+    m_config->setPrimaryOutput(output);
+}
+
+bool ConfigHandler::applyChanges()
+{
+    return requestApply(false);
+}
+
+bool ConfigHandler::requestApply(bool save)
+{
+    if (!m_transactionActive) {
+        if (!save) {
+            return true;
+        }
+        // Nothing staged, the state to save is the one applied last.
+        if (m_applyPending) {
+            m_applyPendingRequest.save = true;
+        } else if (m_applyOperation) {
+            m_applyRequest.save = true;
+        } else {
+            saveApplied();
         }
-        const int outputRight = output->geometry().right();
-        const int outputBottom = output->geometry().bottom();
+        return true;
+    }
+    if (!KScreen::Config::canBeApplied(m_config)) {
+        qWarning() << "staged display config can not be applied, rolling back";
+        resetChanges();
+        return false;
+    }
+
+    ApplyRequest request;
+    request.base = m_transactionBase;
+    request.history = m_history;
+    request.save = save;
+    endTransaction();
+    m_history.record(request.base, captureConfig());
+    enqueueApply(request);
+    return true;
+}
 
-        if (outputRight > width) {
-            width = outputRight;
+bool ConfigHandler::undo()
+{
+    // The controls are read asynchronously, nothing is applied or saved before they are loaded.
+    if (!m_config || !m_control) {
+        return false;
+    }
+    resetChanges();
+    ApplyRequest request;
+    request.base = captureConfig();
+    request.history = m_history;
+    if (!m_history.undo(m_config)) {
+        return false;
+    }
+    enqueueApply(request);
+    return true;
+}
+
+bool ConfigHandler::redo()
+{
+    if (!m_config || !m_control) {
+        return false;
+    }
+    resetChanges();
+    ApplyRequest request;
+    request.base = captureConfig();
+    request.history = m_history;
+    if (!m_history.redo(m_config)) {
+        return false;
+    }
+    enqueueApply(request);
+    return true;
+}
+
+void ConfigHandler::setHistoryMaxBytes(qint64 maxBytes)
+{
+    m_history.setMaxBytes(maxBytes);
+}
+
+void ConfigHandler::enqueueApply(const ApplyRequest &request)
+{
+    if (!m_applyOperation) {
+        startApply(request);
+        return;
+    }
+
+    // The pending operation sends whatever the live config holds when it starts, so a later
+    // request simply takes the place of an earlier one which did not start yet.
+    if (m_applyPending) {
+        ++m_applySuperseded;
+        m_applyPendingRequest.save |= request.save;
+        Q_EMIT applyFinished(ApplyResult::Superseded);
+    } else {
+        m_applyPending = true;
+        m_applyPendingRequest = request;
+    }
+    m_maxApplyQueueDepth = qMax(m_maxApplyQueueDepth, applyQueueDepth());
+}
+
+void ConfigHandler::startApply(const ApplyRequest &request)
+{
+    // Failures are only known once the backend answers, the state to roll back to is kept until then.
+    m_applyRequest = request;
+    m_applyOperation = new KScreen::SetConfigOperation(m_config);
+    ++m_applyOperations;
+    m_maxApplyQueueDepth = qMax(m_maxApplyQueueDepth, applyQueueDepth());
+    connect(m_applyOperation, &KScreen::ConfigOperation::finished, this, &ConfigHandler::handleApplyFinished);
+}
+
+void ConfigHandler::handleApplyFinished(KScreen::ConfigOperation *op)
+{
+    m_applyOperation = nullptr;
+    const ApplyRequest request = m_applyRequest;
+    m_applyRequest = ApplyRequest();
+
+    if (op->hasError()) {
+        qWarning() << "failed to apply display config:" << op->errorString();
+        // The pending changes were staged on top of the failed ones, both are rolled back,
+        // and so are the history steps they recorded, undid or redid.
+        request.base.restore(m_config);
+        const qint64 historyMaxBytes = m_history.maxBytes();
+        m_history = request.history;
+        m_history.setMaxBytes(historyMaxBytes);
+        if (m_applyPending) {
+            m_applyPending = false;
+            m_applyPendingRequest = ApplyRequest();
+            Q_EMIT applyFinished(ApplyResult::Failed);
         }
-        if (outputBottom > height) {
-            height = outputBottom;
+        Q_EMIT applyFinished(ApplyResult::Failed);
+        return;
+    }
+
+    if (m_applyPending) {
+        // The live config already holds the pending changes, saving waits for them.
+        m_applyPendingRequest.save |= request.save;
+    } else if (request.save) {
+        saveApplied();
+    }
+    Q_EMIT applyFinished(ApplyResult::Applied);
+    if (m_applyPending) {
+        m_applyPending = false;
+        const ApplyRequest pending = m_applyPendingRequest;
+        m_applyPendingRequest = ApplyRequest();
+        startApply(pending);
+    }
+}
+
+int ConfigHandler::applyQueueDepth() const
+{
+    return (m_applyOperation ? 1 : 0) + (m_applyPending ? 1 : 0);
+}
+
+void ConfigHandler::resetChanges()
+{
+    if (!m_transactionActive) {
+        return;
+    }
+    m_transactionBase.restore(m_config);
+    endTransaction();
+}
+
+bool ConfigHandler::save()
+{
+    if (!m_config || !m_control) {
+        return false;
+    }
+    return requestApply(true);
+}
+
+void ConfigHandler::saveApplied()
+{
+    // Control files are only written on save, a settings UI saving after each change ends in
+    // a single flush.
+    writeControl();
+    updateInitialData();
+}
+
+QSize ConfigHandler::screenSize() const
+{
+    if (m_screenRight > 0 && m_screenBottom > 0) {
+        return QSize(m_screenRight, m_screenBottom);
+    }
+    return QSize();
+}
+
+void ConfigHandler::trackOutputGeometry(const KScreen::OutputPtr &output)
+{
+    updateOutputRect(output);
+
+    auto update = [this, output]() {
+        if (updateOutputRect(output)) {
+            checkScreenNormalization();
         }
+    };
+    // clang-format off
+    connect(output.data(), &KScreen::Output::posChanged,            this, update);
+    connect(output.data(), &KScreen::Output::sizeChanged,           this, update);
+    connect(output.data(), &KScreen::Output::currentModeIdChanged,  this, update);
+    connect(output.data(), &KScreen::Output::rotationChanged,       this, update);
+    connect(output.data(), &KScreen::Output::scaleChanged,          this, update);
+    connect(output.data(), &KScreen::Output::isEnabledChanged,      this, update);
+    connect(output.data(), &KScreen::Output::isConnectedChanged,    this, update);
+    // Replicas are not positionable.
+    connect(output.data(), &KScreen::Output::replicationSourceChanged, this, update);
+    // clang-format on
+}
+
+bool ConfigHandler::updateOutputRect(const KScreen::OutputPtr &output)
+{
+    const QRect rect = output->isPositionable() ? output->geometry() : QRect();
+    return setOutputRect(output->id(), rect);
+}
+
+bool ConfigHandler::setOutputRect(int outputId, const QRect &rect)
+{
+    const QRect oldRect = m_outputRects.value(outputId);
+    if (rect == oldRect) {
+        return false;
+    }
+    if (rect.isNull()) {
+        m_outputRects.remove(outputId);
+    } else {
+        m_outputRects.insert(outputId, rect);
     }
-    if (width > 0 && height > 0) {
-        size = QSize(width, height);
+
+    const int oldRight = m_screenRight;
+    const int oldBottom = m_screenBottom;
+    if ((oldRect.right() >= m_screenRight && rect.right() < oldRect.right())
+        || (oldRect.bottom() >= m_screenBottom && rect.bottom() < oldRect.bottom())) {
+        // The output was on the edge and moved inwards, another one may be on the edge now.
+        m_screenRight = 0;
+        m_screenBottom = 0;
+        for (const auto &outputRect : qAsConst(m_outputRects)) {
+            m_screenRight = qMax(m_screenRight, outputRect.right());
+            m_screenBottom = qMax(m_screenBottom, outputRect.bottom());
+        }
     } else {
-        size = QSize();
+        m_screenRight = qMax(m_screenRight, rect.right());
+        m_screenBottom = qMax(m_screenBottom, rect.bottom());
     }
-    return size;
+    return m_screenRight != oldRight || m_screenBottom != oldBottom;
 }
 
 QSize ConfigHandler::normalizeScreen()
@@ -195,17 +636,49 @@ QSize ConfigHandler::normalizeScreen()
         return QSize();
     }
 
+    // The positionable outputs are packed, replicas are not among them and follow their source.
+    QVector<KScreen::OutputPtr> outputs;
+    QVector<QRect> rects;
+    outputs.reserve(m_outputRects.count());
+    rects.reserve(m_outputRects.count());
+    for (auto it = m_outputRects.cbegin(); it != m_outputRects.cend(); ++it) {
+        if (const auto output = m_config->output(it.key())) {
+            outputs << output;
+            rects << it.value();
+        }
+    }
+    const auto positions = LayoutNormalizer::normalize(rects);
+    for (int i = 0; i < outputs.count(); ++i) {
+        setOutputPosition(outputs.at(i), positions.at(i));
+    }
+
+    const auto allOutputs = m_config->outputs();
+    for (const auto &output : allOutputs) {
+        if (!output->isConnected() || output->replicationSource() == 0) {
+            continue;
+        }
+        if (const auto source = m_config->output(output->replicationSource())) {
+            setOutputPosition(output, source->pos());
+        }
+    }
+
     const auto currentScreenSize = screenSize();
     m_lastNormalizedScreenSize = currentScreenSize;
 
-    Q_EMIT screenNormalizationUpdate(true);
+    if (!m_screenNormalized) {
+        m_screenNormalized = true;
+        Q_EMIT screenNormalizationUpdate(true);
+    }
     return currentScreenSize;
 }
 
 void ConfigHandler::checkScreenNormalization()
 {
     const bool normalized = !m_config || (m_lastNormalizedScreenSize == screenSize());
-
+    if (normalized == m_screenNormalized) {
+        return;
+    }
+    m_screenNormalized = normalized;
     Q_EMIT screenNormalizationUpdate(normalized);
 }
 
@@ -218,9 +691,25 @@ void ConfigHandler::primaryOutputSelected(int index)
 void ConfigHandler::primaryOutputChanged(const KScreen::OutputPtr &output)
 {
     Q_UNUSED(output)
+    checkNeedsSave();
 }
 
 Control::OutputRetention ConfigHandler::getRetention() const
+{
+    if (!m_retentionValid) {
+        m_retention = computeRetention();
+        // Not cached until the controls are there.
+        m_retentionValid = bool(m_control);
+    }
+    return m_retention;
+}
+
+void ConfigHandler::invalidateRetention()
+{
+    m_retentionValid = false;
+}
+
+Control::OutputRetention ConfigHandler::computeRetention() const
 {
     using Retention = Control::OutputRetention;
 
@@ -270,10 +759,10 @@ void ConfigHandler::setRetention(int retention)
         return;
     }
     auto ret = static_cast<Retention>(retention);
-    const auto connectedOutputs = m_config->connectedOutputs();
-    for (const auto &output : connectedOutputs) {
-        m_control->setOutputRetention(output, ret);
-    }
+    m_control->setOutputRetention(m_config->connectedOutputs(), ret);
+    // All connected outputs have the same retention now.
+    m_retention = ret;
+    m_retentionValid = true;
     checkNeedsSave();
     Q_EMIT retentionChanged();
     Q_EMIT changed();
@@ -281,71 +770,116 @@ void ConfigHandler::setRetention(int retention)
 
 qreal ConfigHandler::scale(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        // Controls not loaded yet, the defaults apply.
+        return ControlRecord().scale;
+    }
     return m_control->getScale(output);
 }
 
 void ConfigHandler::setScale(KScreen::OutputPtr &output, qreal scale)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setScale(output, scale);
 }
 
 KScreen::OutputPtr ConfigHandler::replicationSource(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        return KScreen::OutputPtr();
+    }
     return m_control->getReplicationSource(output);
 }
 
 void ConfigHandler::setReplicationSource(KScreen::OutputPtr &output, const KScreen::OutputPtr &source)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setReplicationSource(output, source);
 }
 
 bool ConfigHandler::autoRotate(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        return ControlRecord().autoRotate;
+    }
     return m_control->getAutoRotate(output);
 }
 
 void ConfigHandler::setAutoRotate(KScreen::OutputPtr &output, bool autoRotate)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setAutoRotate(output, autoRotate);
+    updateControlChanges(output);
 }
 
 bool ConfigHandler::autoRotateOnlyInTabletMode(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        return ControlRecord().autoRotateTabletOnly;
+    }
     return m_control->getAutoRotateOnlyInTabletMode(output);
 }
 
 void ConfigHandler::setAutoRotateOnlyInTabletMode(KScreen::OutputPtr &output, bool value)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setAutoRotateOnlyInTabletMode(output, value);
+    updateControlChanges(output);
 }
 
 uint32_t ConfigHandler::overscan(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        return ControlRecord().overscan;
+    }
     return m_control->getOverscan(output);
 }
 
 void ConfigHandler::setOverscan(const KScreen::OutputPtr &output, uint32_t value)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setOverscan(output, value);
 }
 
 KScreen::Output::VrrPolicy ConfigHandler::vrrPolicy(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        return ControlRecord().vrrPolicy;
+    }
     return m_control->getVrrPolicy(output);
 }
 
 void ConfigHandler::setVrrPolicy(const KScreen::OutputPtr &output, KScreen::Output::VrrPolicy value)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setVrrPolicy(output, value);
 }
 
 KScreen::Output::RgbRange ConfigHandler::rgbRange(const KScreen::OutputPtr &output) const
 {
+    if (!m_control) {
+        return ControlRecord().rgbRange;
+    }
     return m_control->getRgbRange(output);
 }
 
 void ConfigHandler::setRgbRange(const KScreen::OutputPtr &output, KScreen::Output::RgbRange value)
 {
+    if (!m_control) {
+        return;
+    }
     m_control->setRgbRange(output, value);
 }
 
@@ -354,6 +888,43 @@ void ConfigHandler::writeControl()
     if (!m_control) {
         return;
     }
-    m_control->writeFile();
+    m_writeCompressor->start();
+}
+
+void ConfigHandler::flushControl()
+{
+    m_writeCompressor->stop();
+    if (!m_control) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    if (!m_control->writeFile()) {
+        qWarning() << "failed to write display control files";
+    }
+    m_lastFlushUsecs = timer.nsecsElapsed() / 1000;
+    m_maxFlushUsecs = qMax(m_maxFlushUsecs, m_lastFlushUsecs);
+    ++m_controlFlushes;
+}
+
+QVariantMap ConfigHandler::statistics() const
+{
+    const auto &writeStatistics = Control::writeStatistics();
+
+    QVariantMap stats;
+    stats[QStringLiteral("ControlFlushes")] = m_controlFlushes;
+    stats[QStringLiteral("ControlFlushLastUsec")] = m_lastFlushUsecs;
+    stats[QStringLiteral("ControlFlushMaxUsec")] = m_maxFlushUsecs;
+    stats[QStringLiteral("ControlFilesWritten")] = writeStatistics.filesWritten;
+    stats[QStringLiteral("ControlFilesSkipped")] = writeStatistics.filesSkipped;
+    stats[QStringLiteral("ApplyOperations")] = m_applyOperations;
+    stats[QStringLiteral("ApplySuperseded")] = m_applySuperseded;
+    stats[QStringLiteral("ApplyQueueDepth")] = applyQueueDepth();
+    stats[QStringLiteral("ApplyQueueMaxDepth")] = m_maxApplyQueueDepth;
+    stats[QStringLiteral("HistorySteps")] = m_history.count();
+    stats[QStringLiteral("HistoryBytes")] = m_history.bytes();
+    stats[QStringLiteral("ConfigUpdatesInPlace")] = m_configUpdatesInPlace;
+    return stats;
 }
 
@@ -6,8 +6,14 @@
 #define DDE_DISPLAY_CONFIG_H
 
 #include "../common/control.h"
+#include "configdiff.h"
+#include "confighistory.h"
 
 #include <kscreen/config.h>
+#include <kscreen/configoperation.h>
+
+#include <QRect>
+#include <QTimer>
 
 namespace dde {
 namespace display {
@@ -16,12 +22,23 @@ class ConfigHandler : public QObject
 {
     Q_OBJECT
 public:
+    enum class ApplyResult {
+        Applied,
+        Failed,
+        // Replaced by a later request before it was sent to the backend.
+        Superseded,
+    };
+    Q_ENUM(ApplyResult)
+
     explicit ConfigHandler(QObject *parent = nullptr);
-    ~ConfigHandler() override = default;
+    ~ConfigHandler() override;
 
+    // Takes over a config from the backend. A newer config of the same outputs is absorbed
+    // in place, only the outputs which differ from the previous one are set up again.
     void setConfig(KScreen::ConfigPtr config);
     void updateInitialData();
 
+    // Stages positions which pack the outputs without gaps or overlaps from (0, 0).
     QSize normalizeScreen();
 
     KScreen::ConfigPtr config() const
@@ -29,15 +46,12 @@ public:
         return m_config;
     }
 
-    KScreen::ConfigPtr initialConfig() const
+    const ConfigSnapshot &initialConfig() const
     {
         return m_initialConfig;
     }
 
-    void revertConfig()
-    {
-        m_config = m_previousConfig->clone();
-    }
+    void revertConfig();
 
     int retention() const;
     void setRetention(int retention);
@@ -62,46 +76,144 @@ public:
     KScreen::Output::RgbRange rgbRange(const KScreen::OutputPtr &output) const;
     void setRgbRange(const KScreen::OutputPtr &output, KScreen::Output::RgbRange value);
 
+    // Schedules a write of the control files, bursts of calls are folded into one flush.
     void writeControl();
+    void flushControl();
+    // Flushes only if a write is scheduled.
+    void flushPendingControl();
+
+    QVariantMap statistics() const;
 
     void checkNeedsSave();
     bool shouldTestNewSettings();
 
+    /**
+     * Output changes are staged on the live config and sent to the backend together, as a single
+     * KScreen::SetConfigOperation, by applyChanges(). resetChanges() and a failing apply go back
+     * to the state before the first staged change.
+     */
+    void setOutputEnabled(const KScreen::OutputPtr &output, bool enabled);
+    void setOutputMode(const KScreen::OutputPtr &output, const QString &modeId);
+    void setOutputPosition(const KScreen::OutputPtr &output, const QPoint &pos);
+    void setOutputRotation(const KScreen::OutputPtr &output, KScreen::Output::Rotation rotation);
+    void setPrimaryOutput(const KScreen::OutputPtr &output);
+    bool hasPendingChanges() const
+    {
+        return m_transactionActive;
+    }
+    // Returns false if the staged config can not be applied, it is rolled back in that case.
+    // At most one operation is in flight, requests made meanwhile are merged into the next one.
+    bool applyChanges();
+    void resetChanges();
+    // Applies pending changes and makes the current state the initial one once the backend
+    // accepted it, together with writing the control files.
+    bool save();
+
+    // Step through the applied layouts, staged changes are dropped first.
+    bool undo();
+    bool redo();
+    void setHistoryMaxBytes(qint64 maxBytes);
+
 Q_SIGNALS:
     void outputModelChanged();
     void changed();
+    // The controls of the config passed to setConfig() are loaded and the outputs initialized.
+    void configLoaded();
     void screenNormalizationUpdate(bool normalized);
     void needsSaveChecked(bool need);
     void retentionChanged();
     void outputConnect(bool connected);
     void addMonitor(const KScreen::OutputPtr &output);
-    void removeMonitor(const KScreen::OutputPtr &output);
+    void removeMonitor(int outputId);
     void monitorChanged(const KScreen::OutputPtr &output);
+    void pendingChangesChanged(bool pending);
+    // Emitted once for every successful applyChanges() call.
+    void applyFinished(ApplyResult result);
 
 private:
+    void initControls(const ControlFiles &files);
+    void updateConfig(KScreen::ConfigPtr config);
+    void connectConfig();
     void checkScreenNormalization();
     QSize screenSize() const;
+    // Keeps the cached rect of output and the bounding box of all outputs up to date.
+    void trackOutputGeometry(const KScreen::OutputPtr &output);
+    // Return whether the bounding box changed.
+    bool updateOutputRect(const KScreen::OutputPtr &output);
+    bool setOutputRect(int outputId, const QRect &rect);
+    // Cached, recomputed only after the retention or the set of connected outputs changed.
     Control::OutputRetention getRetention() const;
+    Control::OutputRetention computeRetention() const;
+    void invalidateRetention();
     void primaryOutputSelected(int index);
     void primaryOutputChanged(const KScreen::OutputPtr &output);
     void initOutput(const KScreen::OutputPtr &output);
     void resetScale(const KScreen::OutputPtr &output);
-    /**
-     * @brief checkSaveandTestCommon - compairs common config changes that would make the config dirty and needed to have the config checked when applied.
-     * @param isSaveCheck - True  if your checking to see if the changes should request a save.
-     *                      False if you want to check if you should test the config when applied.
-     * @return true, if you should check for a save or test the new configuration
-     */
-    bool checkSaveandTestCommon(bool isSaveCheck);
+    // Hands the differences of the fields kept in the controls to m_diff.
+    void updateControlChanges(const KScreen::OutputPtr &output);
+    void updateControlChanges();
+
+    // Captures the current state of the controls into the snapshot of an output.
+    void captureControl(OutputSnapshot &snapshot, const KScreen::OutputPtr &output) const;
+    ConfigSnapshot captureConfig() const;
+    // An apply which is sent to the backend or waits for it, and what to do once it succeeded.
+    struct ApplyRequest {
+        // State before the changes, rolled back to if the backend rejects them.
+        ConfigSnapshot base;
+        // History before the changes, the steps they added or moved over are dropped with them.
+        ConfigHistory history;
+        // Make the applied state the initial one and write the controls.
+        bool save = false;
+    };
+
+    void beginTransaction();
+    void endTransaction();
+    bool requestApply(bool save);
+    void enqueueApply(const ApplyRequest &request);
+    void startApply(const ApplyRequest &request);
+    void handleApplyFinished(KScreen::ConfigOperation *op);
+    int applyQueueDepth() const;
+    void saveApplied();
 
     KScreen::ConfigPtr m_config = nullptr;
-    KScreen::ConfigPtr m_initialConfig;
-    KScreen::ConfigPtr m_previousConfig = nullptr;
+    // State when the config was loaded or last saved, and the state saved before that.
+    ConfigSnapshot m_initialConfig;
+    ConfigSnapshot m_previousConfig;
+    // State before the first staged change of the open transaction.
+    ConfigSnapshot m_transactionBase;
+    bool m_transactionActive = false;
+
+    // The operation sent to the backend and the state before it, and whether another one
+    // should follow with the state before the changes it sends.
+    KScreen::ConfigOperation *m_applyOperation = nullptr;
+    ApplyRequest m_applyRequest;
+    bool m_applyPending = false;
+    ApplyRequest m_applyPendingRequest;
+    quint64 m_applyOperations = 0;
+    ConfigHistory m_history;
+    quint64 m_applySuperseded = 0;
+    int m_maxApplyQueueDepth = 0;
+    // Reloads absorbed without reading the controls again.
+    quint64 m_configUpdatesInPlace = 0;
 
     std::unique_ptr<ControlConfig> m_control;
-    std::unique_ptr<ControlConfig> m_initialControl;
     Control::OutputRetention m_initialRetention = Control::OutputRetention::Undefined;
+    mutable Control::OutputRetention m_retention = Control::OutputRetention::Undefined;
+    mutable bool m_retentionValid = false;
     QSize m_lastNormalizedScreenSize;
+    bool m_screenNormalized = true;
+    // Geometry of the positionable outputs by id, and the right and bottom edge of their union.
+    QHash<int, QRect> m_outputRects;
+    int m_screenRight = 0;
+    int m_screenBottom = 0;
+
+    ConfigDiff *m_diff;
+    bool m_needsSave = false;
+
+    QTimer *m_writeCompressor;
+    quint64 m_controlFlushes = 0;
+    qint64 m_lastFlushUsecs = 0;
+    qint64 m_maxFlushUsecs = 0;
 };
 
 }
@@ -0,0 +1,169 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "configdiff.h"
+
+using namespace KScreen;
+using namespace dde::display;
+
+ConfigDiff::ConfigDiff(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void ConfigDiff::setConfigs(const KScreen::ConfigPtr &config, const ConfigSnapshot &initialConfig)
+{
+    if (m_config) {
+        disconnect(m_config.data(), nullptr, this, nullptr);
+        for (const auto &entry : qAsConst(m_entries)) {
+            disconnect(entry.output.data(), nullptr, this, nullptr);
+        }
+    }
+    m_config = config;
+    m_initialConfig = initialConfig;
+    m_entries.clear();
+    m_saveDirty = 0;
+    m_testDirty = 0;
+
+    if (!m_config) {
+        Q_EMIT changed();
+        return;
+    }
+
+    const auto outputs = m_config->outputs();
+    m_entries.reserve(outputs.count());
+    for (const auto &output : outputs) {
+        addOutput(output);
+    }
+
+    connect(m_config.data(), &KScreen::Config::outputAdded, this, &ConfigDiff::addOutput);
+    connect(m_config.data(), &KScreen::Config::outputRemoved, this, &ConfigDiff::removeOutput);
+
+    Q_EMIT changed();
+}
+
+void ConfigDiff::addOutput(const KScreen::OutputPtr &output)
+{
+    const int id = output->id();
+    Entry &entry = m_entries[id];
+    entry.output = output;
+    if (const auto *initial = m_initialConfig.output(id)) {
+        entry.initial = *initial;
+    }
+
+    auto *object = output.data();
+    auto update = [this, id]() {
+        updateOutput(id);
+    };
+    // clang-format off
+    connect(object, &KScreen::Output::isConnectedChanged,      this, update);
+    connect(object, &KScreen::Output::isEnabledChanged,        this, update);
+    connect(object, &KScreen::Output::currentModeIdChanged,    this, update);
+    connect(object, &KScreen::Output::posChanged,              this, update);
+    connect(object, &KScreen::Output::scaleChanged,            this, update);
+    connect(object, &KScreen::Output::rotationChanged,         this, update);
+    connect(object, &KScreen::Output::replicationSourceChanged, this, update);
+    connect(object, &KScreen::Output::overscanChanged,         this, update);
+    connect(object, &KScreen::Output::vrrPolicyChanged,        this, update);
+    connect(object, &KScreen::Output::rgbRangeChanged,         this, update);
+    // clang-format on
+
+    updateOutput(id);
+}
+
+void ConfigDiff::removeOutput(int outputId)
+{
+    const auto it = m_entries.find(outputId);
+    if (it == m_entries.end()) {
+        return;
+    }
+    disconnect(it->output.data(), nullptr, this, nullptr);
+    const bool wasDirty = it->saveDirty || it->testDirty;
+    m_saveDirty -= it->saveDirty;
+    m_testDirty -= it->testDirty;
+    m_entries.erase(it);
+    if (wasDirty) {
+        Q_EMIT changed();
+    }
+}
+
+void ConfigDiff::setControlChanges(const KScreen::OutputPtr &output, Fields changes)
+{
+    const auto it = m_entries.find(output->id());
+    if (it == m_entries.end()) {
+        return;
+    }
+    const Fields fields = (it->changes & ~controlFields) | (changes & controlFields);
+    if (fields == it->changes) {
+        return;
+    }
+    it->changes = fields;
+    updateOutput(output->id());
+}
+
+ConfigDiff::Fields ConfigDiff::changes(int outputId) const
+{
+    return m_entries.value(outputId).changes;
+}
+
+ConfigDiff::Fields ConfigDiff::compare(const KScreen::OutputPtr &output, const OutputSnapshot &initial)
+{
+    Fields changes = 0;
+    // clang-format off
+    if (output->isEnabled() != initial.enabled)                         changes |= fieldBit(Enabled);
+    if (output->currentModeId() != initial.currentModeId)               changes |= fieldBit(Mode);
+    if (output->pos() != initial.pos)                                   changes |= fieldBit(Position);
+    if (output->scale() != initial.scale)                               changes |= fieldBit(Scale);
+    if (output->rotation() != initial.rotation)                         changes |= fieldBit(Rotation);
+    if (output->replicationSource() != initial.replicationSource)       changes |= fieldBit(ReplicationSource);
+    if (output->overscan() != initial.overscan)                         changes |= fieldBit(Overscan);
+    if (output->vrrPolicy() != initial.vrrPolicy)                       changes |= fieldBit(VrrPolicy);
+    if (output->rgbRange() != initial.rgbRange)                         changes |= fieldBit(RgbRange);
+    // clang-format on
+    return changes;
+}
+
+void ConfigDiff::updateOutput(int outputId)
+{
+    const auto it = m_entries.find(outputId);
+    if (it == m_entries.end()) {
+        return;
+    }
+    Entry &entry = it.value();
+
+    const bool hasInitial = entry.initial.id >= 0;
+    if (hasInitial) {
+        entry.changes = compare(entry.output, entry.initial) | (entry.changes & controlFields);
+    }
+
+    // Only the enabled state counts for disabled outputs, and outputs without an initial state
+    // or which are not connected are not compared at all.
+    bool saveDirty = false;
+    bool testDirty = false;
+    if (hasInitial && entry.output->isConnected()) {
+        if (entry.changes & fieldBit(Enabled)) {
+            saveDirty = testDirty = true;
+        } else if (entry.output->isEnabled()) {
+            Fields testFields = entry.changes;
+            if (!(m_config->supportedFeatures() & KScreen::Config::Feature::PerOutputScaling)) {
+                testFields &= ~fieldBit(Scale);
+            }
+            saveDirty = entry.changes != 0;
+            testDirty = testFields != 0;
+        }
+    }
+
+    if (saveDirty == entry.saveDirty && testDirty == entry.testDirty) {
+        return;
+    }
+    const bool wasSaveDirty = m_saveDirty > 0;
+    const bool wasTestDirty = m_testDirty > 0;
+    m_saveDirty += int(saveDirty) - int(entry.saveDirty);
+    m_testDirty += int(testDirty) - int(entry.testDirty);
+    entry.saveDirty = saveDirty;
+    entry.testDirty = testDirty;
+    if (wasSaveDirty != (m_saveDirty > 0) || wasTestDirty != (m_testDirty > 0)) {
+        Q_EMIT changed();
+    }
+}
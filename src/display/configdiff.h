@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DDE_DISPLAY_CONFIGDIFF_H
+#define DDE_DISPLAY_CONFIGDIFF_H
+
+#include "configsnapshot.h"
+
+#include <QHash>
+#include <QObject>
+
+namespace dde {
+namespace display {
+
+/**
+ * Per-output, per-field differences between a live config and the config it started from.
+ * Outputs are paired by id. The change set of an output is recomputed only when one of its
+ * own fields changes, so asking whether the config needs saving or testing is cheap.
+ */
+class ConfigDiff : public QObject
+{
+    Q_OBJECT
+public:
+    enum Field {
+        Enabled,
+        Mode,
+        Position,
+        Scale,
+        Rotation,
+        ReplicationSource,
+        AutoRotate,
+        AutoRotateTabletOnly,
+        Overscan,
+        VrrPolicy,
+        RgbRange,
+    };
+    using Fields = quint16;
+
+    static constexpr Fields fieldBit(Field field)
+    {
+        return Fields(1u << field);
+    }
+
+    // Fields which are kept in the control files instead of the KScreen config.
+    static constexpr Fields controlFields = fieldBit(AutoRotate) | fieldBit(AutoRotateTabletOnly);
+
+    explicit ConfigDiff(QObject *parent = nullptr);
+
+    void setConfigs(const KScreen::ConfigPtr &config, const ConfigSnapshot &initialConfig);
+
+    // Control fields are not visible in the outputs, their changes are handed in by the owner.
+    void setControlChanges(const KScreen::OutputPtr &output, Fields changes);
+
+    Fields changes(int outputId) const;
+
+    // Whether any connected output differs in a way that needs saving, or testing when applied.
+    bool needsSave() const
+    {
+        return m_saveDirty > 0;
+    }
+    bool needsTest() const
+    {
+        return m_testDirty > 0;
+    }
+
+Q_SIGNALS:
+    // The result of needsSave() or needsTest() may have changed.
+    void changed();
+
+private:
+    struct Entry {
+        KScreen::OutputPtr output;
+        // Id is -1 if the output is not in the initial config.
+        OutputSnapshot initial;
+        Fields changes = 0;
+        bool saveDirty = false;
+        bool testDirty = false;
+    };
+
+    void addOutput(const KScreen::OutputPtr &output);
+    void removeOutput(int outputId);
+    void updateOutput(int outputId);
+    static Fields compare(const KScreen::OutputPtr &output, const OutputSnapshot &initial);
+
+    KScreen::ConfigPtr m_config;
+    ConfigSnapshot m_initialConfig;
+    QHash<int, Entry> m_entries;
+    // Number of entries which are dirty for saving and for testing.
+    int m_saveDirty = 0;
+    int m_testDirty = 0;
+};
+
+}
+}
+
+#endif // DDE_DISPLAY_CONFIGDIFF_H
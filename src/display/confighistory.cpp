@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "confighistory.h"
+
+using namespace KScreen;
+using namespace dde::display;
+
+ConfigHistory::ConfigHistory(qint64 maxBytes)
+    : m_maxBytes(maxBytes)
+{
+}
+
+void ConfigHistory::setMaxBytes(qint64 maxBytes)
+{
+    m_maxBytes = maxBytes > 0 ? maxBytes : s_defaultMaxBytes;
+    trim();
+}
+
+bool ConfigHistory::differs(const OutputSnapshot &a, const OutputSnapshot &b)
+{
+    // clang-format off
+    return a.currentModeId != b.currentModeId
+        || a.pos != b.pos
+        || a.scale != b.scale
+        || a.rotation != b.rotation
+        || a.replicationSource != b.replicationSource
+        || a.overscan != b.overscan
+        || a.vrrPolicy != b.vrrPolicy
+        || a.rgbRange != b.rgbRange
+        || a.enabled != b.enabled
+        || a.primary != b.primary;
+    // clang-format on
+}
+
+void ConfigHistory::record(const ConfigSnapshot &before, const ConfigSnapshot &after)
+{
+    Step step;
+    for (const auto &output : after.outputs) {
+        const auto *previous = before.output(output.id);
+        if (previous && differs(*previous, output)) {
+            step.changes.append({ *previous, output });
+            step.bytes += sizeof(OutputChange) + (previous->currentModeId.size() + output.currentModeId.size()) * sizeof(QChar);
+        }
+    }
+    if (step.changes.isEmpty()) {
+        return;
+    }
+    step.bytes += sizeof(Step);
+
+    while (m_steps.count() > m_cursor) {
+        m_bytes -= m_steps.takeLast().bytes;
+    }
+    m_bytes += step.bytes;
+    m_steps.append(step);
+    m_cursor = m_steps.count();
+    trim();
+}
+
+void ConfigHistory::clear()
+{
+    m_steps.clear();
+    m_cursor = 0;
+    m_bytes = 0;
+}
+
+void ConfigHistory::trim()
+{
+    // The last done step is always kept so the change just made can be undone.
+    while (m_bytes > m_maxBytes && m_cursor > 1) {
+        m_bytes -= m_steps.takeFirst().bytes;
+        --m_cursor;
+    }
+    // Redo steps go from the far end, the next redo must never skip one.
+    while (m_bytes > m_maxBytes && m_steps.count() > qMax(m_cursor, 1)) {
+        m_bytes -= m_steps.takeLast().bytes;
+    }
+}
+
+void ConfigHistory::restore(const KScreen::ConfigPtr &config, const Step &step, bool after)
+{
+    KScreen::OutputPtr primary;
+    bool primaryChanged = false;
+    for (const auto &change : step.changes) {
+        const auto &snapshot = after ? change.after : change.before;
+        const auto output = config->output(snapshot.id);
+        if (!output) {
+            continue;
+        }
+        snapshot.restore(output);
+        if (change.before.primary != change.after.primary) {
+            primaryChanged = true;
+            if (snapshot.primary) {
+                primary = output;
+            }
+        }
+    }
+    if (primaryChanged && config->supportedFeatures() & KScreen::Config::Feature::PrimaryDisplay) {
+        config->setPrimaryOutput(primary);
+    }
+}
+
+bool ConfigHistory::undo(const KScreen::ConfigPtr &config)
+{
+    if (!config || !canUndo()) {
+        return false;
+    }
+    --m_cursor;
+    restore(config, m_steps.at(m_cursor), false);
+    return true;
+}
+
+bool ConfigHistory::redo(const KScreen::ConfigPtr &config)
+{
+    if (!config || !canRedo()) {
+        return false;
+    }
+    restore(config, m_steps.at(m_cursor), true);
+    ++m_cursor;
+    return true;
+}
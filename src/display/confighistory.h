@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DDE_DISPLAY_CONFIGHISTORY_H
+#define DDE_DISPLAY_CONFIGHISTORY_H
+
+#include "configsnapshot.h"
+
+#include <QList>
+
+namespace dde {
+namespace display {
+
+/**
+ * Undo and redo history of applied layouts. Each step only keeps the outputs it changed. Once the
+ * history takes more than its memory limit, the oldest done steps are dropped, then the farthest
+ * steps which could be redone. Copies share their steps until one of them changes.
+ */
+class ConfigHistory
+{
+public:
+    explicit ConfigHistory(qint64 maxBytes = s_defaultMaxBytes);
+
+    void setMaxBytes(qint64 maxBytes);
+    qint64 maxBytes() const
+    {
+        return m_maxBytes;
+    }
+
+    // Adds the step from before to after and drops the steps which could have been redone.
+    void record(const ConfigSnapshot &before, const ConfigSnapshot &after);
+    void clear();
+
+    bool canUndo() const
+    {
+        return m_cursor > 0;
+    }
+    bool canRedo() const
+    {
+        return m_cursor < m_steps.count();
+    }
+    // Restore the outputs changed by the step on config, return false if there is none.
+    bool undo(const KScreen::ConfigPtr &config);
+    bool redo(const KScreen::ConfigPtr &config);
+
+    int count() const
+    {
+        return m_steps.count();
+    }
+    qint64 bytes() const
+    {
+        return m_bytes;
+    }
+
+    static constexpr qint64 s_defaultMaxBytes = 64 * 1024;
+
+private:
+    struct OutputChange {
+        OutputSnapshot before;
+        OutputSnapshot after;
+    };
+    struct Step {
+        QVector<OutputChange> changes;
+        qint64 bytes = 0;
+    };
+
+    static bool differs(const OutputSnapshot &a, const OutputSnapshot &b);
+    static void restore(const KScreen::ConfigPtr &config, const Step &step, bool after);
+    void trim();
+
+    QList<Step> m_steps;
+    // Number of steps which are done, the next undo reverts m_steps[m_cursor - 1].
+    int m_cursor = 0;
+    qint64 m_bytes = 0;
+    qint64 m_maxBytes;
+};
+
+}
+}
+
+#endif // DDE_DISPLAY_CONFIGHISTORY_H
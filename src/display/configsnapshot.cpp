@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "configsnapshot.h"
+#include "../common/outputidentity.h"
+
+using namespace KScreen;
+using namespace dde::display;
+
+OutputSnapshot OutputSnapshot::capture(const KScreen::OutputPtr &output)
+{
+    OutputSnapshot snapshot;
+    snapshot.id = output->id();
+    snapshot.token = OutputIdentity::token(output);
+    snapshot.currentModeId = output->currentModeId();
+    snapshot.pos = output->pos();
+    snapshot.scale = output->scale();
+    snapshot.rotation = output->rotation();
+    snapshot.replicationSource = output->replicationSource();
+    snapshot.overscan = output->overscan();
+    snapshot.vrrPolicy = output->vrrPolicy();
+    snapshot.rgbRange = output->rgbRange();
+    snapshot.enabled = output->isEnabled();
+    snapshot.primary = output->isPrimary();
+    return snapshot;
+}
+
+void OutputSnapshot::restore(const KScreen::OutputPtr &output) const
+{
+    // clang-format off
+    if (output->currentModeId() != currentModeId)           output->setCurrentModeId(currentModeId);
+    if (output->pos() != pos)                               output->setPos(pos);
+    if (output->scale() != scale)                           output->setScale(scale);
+    if (output->rotation() != rotation)                     output->setRotation(rotation);
+    if (output->replicationSource() != replicationSource)   output->setReplicationSource(replicationSource);
+    if (output->overscan() != overscan)                     output->setOverscan(overscan);
+    if (output->vrrPolicy() != vrrPolicy)                   output->setVrrPolicy(vrrPolicy);
+    if (output->rgbRange() != rgbRange)                     output->setRgbRange(rgbRange);
+    if (output->isEnabled() != enabled)                     output->setEnabled(enabled);
+    // clang-format on
+}
+
+ConfigSnapshot ConfigSnapshot::capture(const KScreen::ConfigPtr &config)
+{
+    ConfigSnapshot snapshot;
+    if (!config) {
+        return snapshot;
+    }
+    const auto outputs = config->outputs();
+    snapshot.outputs.reserve(outputs.count());
+    for (const auto &output : outputs) {
+        snapshot.outputs.append(OutputSnapshot::capture(output));
+    }
+    return snapshot;
+}
+
+void ConfigSnapshot::restore(const KScreen::ConfigPtr &config) const
+{
+    if (!config || isNull()) {
+        return;
+    }
+    KScreen::OutputPtr primary;
+    for (const auto &outputSnapshot : outputs) {
+        const auto output = config->output(outputSnapshot.id);
+        if (!output) {
+            continue;
+        }
+        outputSnapshot.restore(output);
+        if (outputSnapshot.primary) {
+            primary = output;
+        }
+    }
+    if (config->supportedFeatures() & KScreen::Config::Feature::PrimaryDisplay && config->primaryOutput() != primary) {
+        config->setPrimaryOutput(primary);
+    }
+}
+
+const OutputSnapshot *ConfigSnapshot::output(int outputId) const
+{
+    for (const auto &output : outputs) {
+        if (output.id == outputId) {
+            return &output;
+        }
+    }
+    return nullptr;
+}
+
+OutputSnapshot *ConfigSnapshot::output(int outputId)
+{
+    for (auto &output : outputs) {
+        if (output.id == outputId) {
+            return &output;
+        }
+    }
+    return nullptr;
+}
+
+const OutputSnapshot *ConfigSnapshot::primaryOutput() const
+{
+    for (const auto &output : outputs) {
+        if (output.primary) {
+            return &output;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DDE_DISPLAY_CONFIGSNAPSHOT_H
+#define DDE_DISPLAY_CONFIGSNAPSHOT_H
+
+#include <kscreen/config.h>
+#include <kscreen/output.h>
+
+#include <QPoint>
+#include <QVector>
+
+namespace dde {
+namespace display {
+
+/**
+ * The fields of an output which are compared and restored, without its modes or any other
+ * data which a full KScreen::Output clone would copy.
+ */
+struct OutputSnapshot
+{
+    int id = -1;
+    uint token = 0;
+    QString currentModeId;
+    QPoint pos;
+    qreal scale = 1.0;
+    KScreen::Output::Rotation rotation = KScreen::Output::None;
+    int replicationSource = 0;
+    uint32_t overscan = 0;
+    KScreen::Output::VrrPolicy vrrPolicy = KScreen::Output::VrrPolicy::Automatic;
+    KScreen::Output::RgbRange rgbRange = KScreen::Output::RgbRange::Automatic;
+    bool enabled = false;
+    bool primary = false;
+
+    // Kept in the control files rather than in the config.
+    bool autoRotate = true;
+    bool autoRotateTabletOnly = true;
+
+    static OutputSnapshot capture(const KScreen::OutputPtr &output);
+    // Sets the fields on output, setters are only called for fields which differ.
+    void restore(const KScreen::OutputPtr &output) const;
+};
+
+struct ConfigSnapshot
+{
+    QVector<OutputSnapshot> outputs;
+
+    static ConfigSnapshot capture(const KScreen::ConfigPtr &config);
+    // Restores the outputs of config which are in the snapshot, matched by id. A null
+    // snapshot leaves config as it is.
+    void restore(const KScreen::ConfigPtr &config) const;
+
+    bool isNull() const
+    {
+        return outputs.isEmpty();
+    }
+    const OutputSnapshot *output(int outputId) const;
+    OutputSnapshot *output(int outputId);
+    const OutputSnapshot *primaryOutput() const;
+};
+
+}
+}
+
+#endif // DDE_DISPLAY_CONFIGSNAPSHOT_H
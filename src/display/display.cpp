@@ -5,6 +5,8 @@
 #include "display.h"
 #include "displaymanager.h"
 
+#include <QDBusConnection>
+#include <QDBusMessage>
 #include <QDBusObjectPath>
 #include <QJsonDocument>
 
@@ -19,6 +21,23 @@ Display1::Display1(QObject *parent)
     registerTouchscreenInfoListMetaType();
     registerTouchscreenInfoList_V2MetaType();
     registerTouchscreenMapMetaType();
+
+    connect(m_manager, &DisplayManager::monitorsChanged, this, [this]() {
+        Q_EMIT monitorsChanged(monitors());
+    });
+    connect(m_manager, &DisplayManager::pendingChangesChanged, this, [this](bool pending) {
+        Q_EMIT hasChangedChanged(pending);
+        notifyPropertyChanged(QStringLiteral("HasChanged"), pending);
+    });
+}
+
+void Display1::notifyPropertyChanged(const QString &property, const QVariant &value)
+{
+    QDBusMessage message = QDBusMessage::createSignal(QStringLiteral("/org/deepin/dde/Display1"),
+                                                      QStringLiteral("org.freedesktop.DBus.Properties"),
+                                                      QStringLiteral("PropertiesChanged"));
+    message << QStringLiteral("org.deepin.dde.Display1") << QVariantMap{{property, value}} << QStringList();
+    QDBusConnection::sessionBus().send(message);
 }
 
 void Display1::init()
@@ -28,7 +47,13 @@ void Display1::init()
 
 void Display1::ApplyChanges()
 {
-
+    auto *handler = m_manager ? m_manager->configHandler() : nullptr;
+    if (!handler) {
+        return;
+    }
+    if (!handler->applyChanges() && calledFromDBus()) {
+        sendErrorReply(QDBusError::Failed, QStringLiteral("the changed display config can not be applied"));
+    }
 }
 
 bool Display1::CanRotate()
@@ -57,18 +82,10 @@ QStringList Display1::ListOutputNames()
 
 ResolutionList Display1::ListOutputsCommonModes()
 {
-    ResolutionList list;
     if (!m_manager) {
-        return list;
-    }
-
-    for (auto monitor : m_manager->monitors()) {
-        list.append(Resolution{monitor->id(), monitor->size().width(),
-                               monitor->size().height(),
-                               monitor->currentMode()->refreshRate()});
+        return ResolutionList();
     }
-
-    return list;
+    return m_manager->commonModes();
 }
 
 void Display1::Reset()
@@ -78,17 +95,38 @@ void Display1::Reset()
 
 void Display1::ResetChanges()
 {
-
+    if (auto *handler = m_manager ? m_manager->configHandler() : nullptr) {
+        handler->resetChanges();
+    }
 }
 
 void Display1::Save()
 {
-
+    auto *handler = m_manager ? m_manager->configHandler() : nullptr;
+    if (!handler) {
+        return;
+    }
+    if (!handler->save() && calledFromDBus()) {
+        sendErrorReply(QDBusError::Failed, QStringLiteral("the changed display config can not be applied"));
+    }
 }
 
 void Display1::SetPrimary(const QString &name)
 {
-
+    auto *handler = m_manager ? m_manager->configHandler() : nullptr;
+    if (!handler || !handler->config()) {
+        return;
+    }
+    const auto outputs = handler->config()->connectedOutputs();
+    for (const auto &output : outputs) {
+        if (output->name() == name) {
+            handler->setPrimaryOutput(output);
+            return;
+        }
+    }
+    if (calledFromDBus()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("no connected monitor named %1").arg(name));
+    }
 }
 
 void Display1::SwitchMode(const uchar &mode, const QString &name)
@@ -146,6 +184,37 @@ void Display1::SetMethodAdjustCCT(int in0)
 
 }
 
+QVariantMap Display1::GetStatistics()
+{
+    if (!m_manager) {
+        return QVariantMap();
+    }
+
+    return m_manager->statistics();
+}
+
+void Display1::Undo()
+{
+    auto *handler = m_manager ? m_manager->configHandler() : nullptr;
+    if (!handler) {
+        return;
+    }
+    if (!handler->undo() && calledFromDBus()) {
+        sendErrorReply(QDBusError::Failed, QStringLiteral("there is no display change to undo"));
+    }
+}
+
+void Display1::Redo()
+{
+    auto *handler = m_manager ? m_manager->configHandler() : nullptr;
+    if (!handler) {
+        return;
+    }
+    if (!handler->redo() && calledFromDBus()) {
+        sendErrorReply(QDBusError::Failed, QStringLiteral("there is no display change to redo"));
+    }
+}
+
 QString Display1::primary() const
 {
     QString primary;
@@ -165,7 +234,7 @@ QString Display1::primary() const
 
 quint16 Display1::screenHeight() const
 {
-    quint16 height;
+    quint16 height = 0;
     if (!m_manager) {
         return height;
     }
@@ -181,7 +250,7 @@ quint16 Display1::screenHeight() const
 
 quint16 Display1::screenWidth() const
 {
-    quint16 width;
+    quint16 width = 0;
     if (!m_manager) {
         return width;
     }
@@ -225,6 +294,12 @@ BrightnessMap Display1::brightness() const
     return brightness;
 }
 
+bool Display1::hasChanged() const
+{
+    auto *handler = m_manager ? m_manager->configHandler() : nullptr;
+    return handler && handler->hasPendingChanges();
+}
+
 QList<QDBusObjectPath> Display1::monitors() const
 {
     QList<QDBusObjectPath> monitors;
@@ -33,7 +33,7 @@ class Display1 : public QObject, public QDBusContext
     Q_PROPERTY(quint16 ScreenHeight READ screenHeight NOTIFY screenHeightChanged)
     Q_PROPERTY(quint16 ScreenWidth READ screenWidth NOTIFY screenWidthChanged)
     Q_PROPERTY(BrightnessMap Brightness READ brightness)
-    Q_PROPERTY(bool HasChanged READ hasChanged)
+    Q_PROPERTY(bool HasChanged READ hasChanged NOTIFY hasChangedChanged)
     Q_PROPERTY(quint32 MaxBacklightBrightness READ maxBacklightBrightness)
     Q_PROPERTY(QList<QDBusObjectPath> Monitors READ monitors)
     Q_PROPERTY(QString CurrentCustomId READ currentCustomId)
@@ -46,7 +46,6 @@ class Display1 : public QObject, public QDBusContext
 
 public :
     inline uchar displayMode() const { return 1; }
-    inline bool hasChanged() const { return false; }
     inline quint32 maxBacklightBrightness() const { return 0; }
     inline QString currentCustomId() const { return QString{}; }
     inline QStringList customIdList() const { return QStringList{}; }
@@ -62,6 +61,8 @@ public :
     quint16 screenWidth() const;
     ScreenRect primaryRect() const;
     QList<QDBusObjectPath> monitors() const;
+    bool hasChanged() const;
+    inline dde::display::DisplayManager *manager() const { return m_manager; }
 
     void init();
 
@@ -86,6 +87,9 @@ public Q_SLOTS:
     void SetBrightness(const QString &in0, double in1);
     void SetColorTemperature(int in0);
     void SetMethodAdjustCCT(int in0);
+    QVariantMap GetStatistics();
+    void Undo();
+    void Redo();
 
 public:
     Display1(QObject *parent = nullptr);
@@ -101,8 +105,12 @@ Q_SIGNALS:
     void primaryRectChanged(ScreenRect);
     void screenHeightChanged(quint16);
     void screenWidthChanged(quint16);
+    void hasChangedChanged(bool);
 
 private:
+    // Sends PropertiesChanged for a property of the Display1 interface.
+    void notifyPropertyChanged(const QString &property, const QVariant &value);
+
     uchar m_displayMode;
     QString m_primary;
     ScreenRect m_primaryRect;
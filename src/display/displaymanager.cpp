@@ -4,6 +4,8 @@
 
 #include "displaymanager.h"
 #include "monitoradaptor.h"
+#include "../common/controlcache.h"
+#include "../common/controlstore.h"
 
 #include <kscreen/getconfigoperation.h>
 #include <kscreen/configmonitor.h>
@@ -11,18 +13,75 @@
 
 #include <QProcess>
 #include <QDebug>
-#include <QDBusInterface>
+#include <QMetaEnum>
 #include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
 
 using namespace KScreen;
 using namespace dde::display;
 
+static const QString s_kscreenService = QStringLiteral("org.kde.KScreen");
+
+// Time to wait for the backend to register before loading without it.
+static const int s_backendTimeout = 3000;
+// Default delay after the last hotplug event before the config is reloaded.
+static const int s_defaultLoadCompressInterval = 300;
+// Default time after which the service reports ready even if the monitors are not registered yet.
+static const int s_defaultStartupBudget = 5000;
+
+static QElapsedTimer startedTimer()
+{
+    QElapsedTimer timer;
+    timer.start();
+    return timer;
+}
+
+// Started before main(), the startup stages are timed from here.
+static const QElapsedTimer s_processTimer = startedTimer();
+
 DisplayManager::DisplayManager(QObject *parent)
     : QObject(parent)
     ,m_loadCompressor(new QTimer(this))
     ,m_firstLoad(true)
+    ,m_modeIndex(new ModeIndex(this))
+    ,m_monitorsChangedCompressor(new QTimer(this))
+    ,m_dconfig(Dtk::Core::DConfig::create("dde-display", "org.deepin.dde.display1", QString(), this))
+    ,m_startupStages(QMetaEnum::fromType<StartupStage>().keyCount(), -1)
+    ,m_startupBudget(new QTimer(this))
 {
-    load();
+    // All monitors added or removed in one pass of the event loop are announced together.
+    m_monitorsChangedCompressor->setSingleShot(true);
+    m_monitorsChangedCompressor->setInterval(0);
+    connect(m_monitorsChangedCompressor, &QTimer::timeout, this, &DisplayManager::monitorsChanged);
+
+    // Bursts of connect and disconnect events, as docks cause them, end in a single reload.
+    m_loadCompressor->setSingleShot(true);
+    connect(m_loadCompressor, &QTimer::timeout, this, &DisplayManager::load);
+
+    // A backend which does not come up must not keep the session waiting for the service.
+    m_startupBudget->setSingleShot(true);
+    connect(m_startupBudget, &QTimer::timeout, this, [this]() {
+        qWarning() << "startup budget of" << m_startupBudget->interval() << "ms exceeded, reporting ready";
+        m_startupBudgetExpired = true;
+        setReady();
+    });
+
+    applySettings();
+    connect(m_dconfig, &Dtk::Core::DConfig::valueChanged, this, &DisplayManager::applySettings);
+    const int budget = m_dconfig->value("startupBudget").toInt();
+    m_startupBudget->start(budget > 0 ? budget : s_defaultStartupBudget);
+    // Reached once the event loop runs, main() connects to the stages only after construction.
+    QTimer::singleShot(0, this, [this]() {
+        reachStartupStage(StartupStage::ProcessUp);
+    });
+    ControlStore::instance()->scheduleCompaction();
+
+    // Reading the known layouts overlaps with the backend coming up, the first load waits for it.
+    ControlCache::instance()->prewarm();
+    requestBackend();
 }
 
 DisplayManager::~DisplayManager()
@@ -38,82 +97,243 @@ void DisplayManager::initConnect()
 void DisplayManager::load()
 {
     qDebug() << "ready to read in config.";
+    m_loadCompressor->stop();
+    const quint64 load = ++m_loads;
 
-    if (m_firstLoad) {
-        requestBackend();
-        m_firstLoad = false;
-    }
+    if (!m_configHandler) {
+        // The handler lives as long as the manager, reloads hand it the new config.
+        m_configHandler.reset(new ConfigHandler(this));
+        m_configHandler->setHistoryMaxBytes(m_dconfig->value("historyMaxBytes").toLongLong());
 
-   auto *oldConfig = m_configHandler.release();
-    if (oldConfig) {
-        delete oldConfig;
+        connect(m_configHandler.get(), &ConfigHandler::addMonitor, this, &DisplayManager::handleMonitorAdd);
+        connect(m_configHandler.get(), &ConfigHandler::removeMonitor, this, &DisplayManager::handleMonitorRemove);
+        connect(m_configHandler.get(), &ConfigHandler::monitorChanged, this, &DisplayManager::handleMonitorChange);
+        connect(m_configHandler.get(), &ConfigHandler::outputConnect, this, &DisplayManager::scheduleLoad);
+        connect(m_configHandler.get(), &ConfigHandler::pendingChangesChanged, this, &DisplayManager::pendingChangesChanged);
+        connect(m_configHandler.get(), &ConfigHandler::configLoaded, this, &DisplayManager::syncMonitors);
+        connect(m_configHandler.get(), &ConfigHandler::configLoaded, this, [this]() {
+            // All monitors the handler announced are registered by now.
+            reachStartupStage(StartupStage::MonitorsRegistered);
+        });
     }
 
-    m_configHandler.reset(new ConfigHandler(this));
-
     connect(new GetConfigOperation(), &KScreen::GetConfigOperation::finished,
-            this, [this](KScreen::ConfigOperation *op) {
+            this, [this, load](KScreen::ConfigOperation *op) {
+              if (load != m_loads) {
+                // A later load is on its way.
+                return;
+              }
               if (op->hasError()) {
-                m_configHandler.reset();
+                qWarning() << "failed to read the display config:" << op->errorString();
                 return;
               }
 
               KScreen::ConfigPtr config =
                   qobject_cast<GetConfigOperation *>(op)->config();
+              reachStartupStage(StartupStage::ConfigLoaded);
               m_configHandler->setConfig(config);
             });
+}
 
-    connect(m_configHandler.get(), &ConfigHandler::addMonitor, this, &DisplayManager::handleMonitorAdd);
-    connect(m_configHandler.get(), &ConfigHandler::removeMonitor, this, &DisplayManager::handleMonitorRemove);
-    connect(m_configHandler.get(), &ConfigHandler::monitorChanged, this, &DisplayManager::handleMonitorChange);
+void DisplayManager::scheduleLoad()
+{
+    ++m_hotplugEvents;
+    if (m_loadCompressor->isActive()) {
+        ++m_foldedHotplugEvents;
+    }
+    m_loadCompressor->start();
+}
+
+void DisplayManager::applySettings()
+{
+    ControlStore::instance()->setLimits(m_dconfig->value("controlStoreMaxEntries").toInt(),
+                                        m_dconfig->value("controlStoreMaxBytes").toLongLong());
+    if (m_configHandler) {
+        m_configHandler->setHistoryMaxBytes(m_dconfig->value("historyMaxBytes").toLongLong());
+    }
+    const int interval = m_dconfig->value("hotplugDebounceInterval").toInt();
+    m_loadCompressor->setInterval(interval > 0 ? interval : s_defaultLoadCompressInterval);
+}
+
+QVariantMap DisplayManager::statistics() const
+{
+    QVariantMap statistics = ControlStore::instance()->statistics();
+    statistics[QStringLiteral("HotplugEvents")] = m_hotplugEvents;
+    statistics[QStringLiteral("HotplugFoldedEvents")] = m_foldedHotplugEvents;
+    statistics[QStringLiteral("ConfigLoads")] = m_loads;
+    const QMetaEnum stages = QMetaEnum::fromType<StartupStage>();
+    for (int i = 0; i < m_startupStages.count(); ++i) {
+        statistics[QStringLiteral("Startup%1Msec").arg(QLatin1String(stages.valueToKey(i)))] = m_startupStages.at(i);
+    }
+    statistics[QStringLiteral("StartupReady")] = m_ready;
+    statistics[QStringLiteral("StartupBudgetExpired")] = m_startupBudgetExpired;
+    if (m_configHandler) {
+        statistics.insert(m_configHandler->statistics());
+    }
+    return statistics;
+}
+
+ResolutionList DisplayManager::commonModes()
+{
+    if (!m_configHandler || !m_configHandler->config()) {
+        return ResolutionList();
+    }
+    return m_modeIndex->commonModes(m_configHandler->config());
 }
 
 void DisplayManager::requestBackend()
 {
-    QDBusInterface inter("org.kde.KScreen",
-                             "/",
-                             "org.kde.KScreen",
-                             QDBusConnection::sessionBus());
-    if (!inter.isValid()) {
-        QProcess process;
-        process.start("uname", QStringList() << "-m");
-        process.waitForFinished();
-        QString output = process.readAll();
-        output = output.simplified();
+    // Nothing here may block, this runs on the way to telling systemd that we are ready.
+    m_backendWatcher = new QDBusServiceWatcher(s_kscreenService, QDBusConnection::sessionBus(),
+                                               QDBusServiceWatcher::WatchForRegistration, this);
+    connect(m_backendWatcher, &QDBusServiceWatcher::serviceRegistered, this, &DisplayManager::handleBackendReady);
+
+    auto *watcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().interface()->asyncCall(QStringLiteral("NameHasOwner"), s_kscreenService), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *call) {
+        call->deleteLater();
+        const QDBusPendingReply<bool> reply = *call;
+        if (reply.isValid() && reply.value()) {
+            handleBackendReady();
+            return;
+        }
+        if (!QProcess::startDetached(QStringLiteral(KSCREEN_BACKEND_LAUNCHER), QStringList{})) {
+            // Let libkscreen try to bring up a backend on its own.
+            qWarning() << "failed to start" << KSCREEN_BACKEND_LAUNCHER;
+            firstLoad();
+        }
+    });
+
+    // The launcher may exit or the backend fail without the service ever showing up.
+    QTimer::singleShot(s_backendTimeout, this, [this]() {
+        if (m_firstLoad) {
+            qWarning() << s_kscreenService << "did not show up within" << s_backendTimeout << "ms, loading anyway";
+            firstLoad();
+        }
+    });
+}
+
+void DisplayManager::handleBackendReady()
+{
+    if (m_backendWatcher) {
+        m_backendWatcher->deleteLater();
+        m_backendWatcher = nullptr;
+    }
+    reachStartupStage(StartupStage::BackendConnected);
+    firstLoad();
+}
 
-        QString command = "/usr/lib/" + output + "-linux-gnu"
-                          +"/libexec/kf5/kscreen_backend_launcher";
-        QProcess::startDetached(command, QStringList{});
+void DisplayManager::firstLoad()
+{
+    if (!m_firstLoad) {
+        return;
     }
+    m_firstLoad = false;
+    load();
+}
+
+QString DisplayManager::monitorPath(int outputId)
+{
+    return QString("/org/deepin/dde/Display1") + QString("/Monitor_") + QString::number(outputId);
 }
 
 void DisplayManager::handleMonitorAdd(const KScreen::OutputPtr &output)
-{   
+{
     if (!output) {
-        return;
         qWarning() << "invalid output";
+        return;
     }
 
-    if (!m_monitors.isEmpty()) {
-        m_monitors.clear();
+    const int outputId = output->id();
+    if (m_monitorObjects.contains(outputId)) {
+        // Known output, e.g. after a reconnect or a reload, the object on the bus stays as it is.
+        handleMonitorChange(output);
+        return;
     }
 
+    const QString path = monitorPath(outputId);
     Monitor *monitor = new Monitor(output, this);
 
     new MonitorAdaptor(monitor);
 
-    QString path = QString("/org/deepin/dde/Display1") + QString("/Monitor_") + QString::number(output->id());
-    QDBusConnection::sessionBus().registerObject(path, "org.deepin.dde.Display1.Monitor", monitor);
+    if (!QDBusConnection::sessionBus().registerObject(path, "org.deepin.dde.Display1.Monitor", monitor)) {
+        qWarning() << "failed to register monitor" << path;
+    }
 
+    m_monitorObjects.insert(outputId, monitor);
     m_monitors[path] = output;
+    m_monitorsChangedCompressor->start();
 }
 
-void DisplayManager::handleMonitorRemove(const KScreen::OutputPtr &output)
+void DisplayManager::handleMonitorRemove(int outputId)
 {
-
+    auto *monitor = m_monitorObjects.take(outputId);
+    if (!monitor) {
+        return;
+    }
+    const QString path = monitorPath(outputId);
+    QDBusConnection::sessionBus().unregisterObject(path);
+    monitor->deleteLater();
+    m_monitors.remove(path);
+    m_monitorsChangedCompressor->start();
 }
 
 void DisplayManager::handleMonitorChange(const KScreen::OutputPtr &output)
 {
+    auto *monitor = m_monitorObjects.value(output->id());
+    if (!monitor) {
+        return;
+    }
+    monitor->setOutput(output);
 
+    // Disconnected outputs keep their object on the bus, they are only left out of the list.
+    const QString path = monitorPath(output->id());
+    if (!output->isConnected()) {
+        if (m_monitors.remove(path)) {
+            m_monitorsChangedCompressor->start();
+        }
+        return;
+    }
+    if (!m_monitors.contains(path)) {
+        m_monitorsChangedCompressor->start();
+    }
+    m_monitors[path] = output;
+}
+
+void DisplayManager::syncMonitors()
+{
+    const auto config = m_configHandler->config();
+    const auto outputIds = m_monitorObjects.keys();
+    for (int outputId : outputIds) {
+        // Only outputs which are gone from the config lose their object.
+        if (const auto output = config->output(outputId)) {
+            handleMonitorChange(output);
+        } else {
+            handleMonitorRemove(outputId);
+        }
+    }
+}
+
+void DisplayManager::reachStartupStage(StartupStage stage)
+{
+    qint64 &msecs = m_startupStages[int(stage)];
+    if (msecs >= 0) {
+        return;
+    }
+    msecs = s_processTimer.elapsed();
+    qInfo() << "startup stage" << stage << "reached after" << msecs << "ms";
+    Q_EMIT startupStageReached(stage);
+
+    if (stage == StartupStage::MonitorsRegistered) {
+        setReady();
+    }
+}
+
+void DisplayManager::setReady()
+{
+    if (m_ready) {
+        return;
+    }
+    m_ready = true;
+    m_startupBudget->stop();
+    Q_EMIT ready();
 }
@@ -8,9 +8,16 @@
 #include "displaymanager.h"
 #include "config.h"
 #include "monitor.h"
+#include "modeindex.h"
 
+#include <QDBusServiceWatcher>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QTimer>
+#include <QVector>
+
+#include <DConfig>
 
 namespace dde {
 namespace display {
@@ -20,18 +27,54 @@ class DisplayManager : public QObject
     Q_OBJECT
 
 public:
+    // Stages of the startup, in the order they are reached.
+    enum class StartupStage {
+        ProcessUp,
+        BackendConnected,
+        ConfigLoaded,
+        MonitorsRegistered,
+    };
+    Q_ENUM(StartupStage)
+
     explicit DisplayManager(QObject *parent = nullptr);
     ~DisplayManager();
 
     inline QMap<QString, KScreen::OutputPtr> monitors() { return m_monitors; }
+    // Null while the display config is being loaded.
+    inline ConfigHandler *configHandler() const { return m_configHandler.get(); }
+    QVariantMap statistics() const;
+    // Modes supported by all connected outputs, for mirroring.
+    ResolutionList commonModes();
+    inline ModeIndex *modeIndex() { return m_modeIndex; }
+    // Whether the startup finished, see ready().
+    inline bool isReady() const { return m_ready; }
+
+Q_SIGNALS:
+    // Monitors were registered or unregistered on the bus.
+    void monitorsChanged();
+    // Changes were staged on the config, or the staged changes were applied or reset.
+    void pendingChangesChanged(bool pending);
+    void startupStageReached(StartupStage stage);
+    // Emitted once, when the monitors are registered or the startup budget ran out before.
+    void ready();
 
 private:
     void initConnect();
     void requestBackend();
+    void handleBackendReady();
+    // Runs the first load once, whether or not the backend showed up.
+    void firstLoad();
     void load();
+    void scheduleLoad();
+    static QString monitorPath(int outputId);
     void handleMonitorAdd(const KScreen::OutputPtr &output);
-    void handleMonitorRemove(const KScreen::OutputPtr &output);
+    void handleMonitorRemove(int outputId);
     void handleMonitorChange(const KScreen::OutputPtr &output);
+    // Follows the outputs of a loaded config, removing the monitors of outputs it does not have.
+    void syncMonitors();
+    void applySettings();
+    void reachStartupStage(StartupStage stage);
+    void setReady();
 
 private:
     QTimer *m_loadCompressor;   //reload display settings delayed such that daemon can update output values.
@@ -39,6 +82,22 @@ private:
     std::unique_ptr<ConfigHandler> m_configHandler;
     QMap<QString, KScreen::OutputPtr> m_monitors;
     bool m_firstLoad;
+    QDBusServiceWatcher *m_backendWatcher = nullptr;
+    ModeIndex *m_modeIndex;
+    // Monitor objects on the bus by output id, including those of disconnected outputs.
+    QHash<int, Monitor *> m_monitorObjects;
+    QTimer *m_monitorsChangedCompressor;
+    Dtk::Core::DConfig *m_dconfig;
+
+    quint64 m_hotplugEvents = 0;
+    quint64 m_foldedHotplugEvents = 0;
+    quint64 m_loads = 0;
+
+    // Msecs since the process started at which each stage was reached, -1 until then.
+    QVector<qint64> m_startupStages;
+    QTimer *m_startupBudget;
+    bool m_ready = false;
+    bool m_startupBudgetExpired = false;
 };
 
 }
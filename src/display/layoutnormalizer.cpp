@@ -0,0 +1,224 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "layoutnormalizer.h"
+
+#include <QHash>
+#include <QPair>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+using namespace dde::display;
+
+namespace
+{
+// Upper bound of passes, only reached if a layout does not settle, which should not happen.
+int maxRounds(int count)
+{
+    return 4 * count + 16;
+}
+
+// Edges of a rect along one axis, the end is exclusive.
+int start(const QRect &rect, bool horizontal)
+{
+    return horizontal ? rect.x() : rect.y();
+}
+
+int end(const QRect &rect, bool horizontal)
+{
+    return horizontal ? rect.x() + rect.width() : rect.y() + rect.height();
+}
+
+// Whether the closed ranges [start1, end1] and [start2, end2] share at least a point.
+bool touches(int start1, int end1, int start2, int end2)
+{
+    return start1 <= end2 && start2 <= end1;
+}
+
+/**
+ * Pairs of rects which overlap or touch at an edge or a corner, the first rect of a pair is
+ * not right of the second. Sweeps over the rects ordered by their left edge, keeping those
+ * whose right edge was not passed yet.
+ */
+QVector<QPair<int, int>> contacts(const QVector<QRect> &rects)
+{
+    QVector<int> order(rects.count());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&rects](int a, int b) {
+        const QRect &rectA = rects.at(a);
+        const QRect &rectB = rects.at(b);
+        return rectA.x() != rectB.x() ? rectA.x() < rectB.x() : rectA.y() < rectB.y();
+    });
+
+    QVector<QPair<int, int>> pairs;
+    QVector<int> active;
+    for (int index : qAsConst(order)) {
+        const QRect &rect = rects.at(index);
+        active.erase(std::remove_if(active.begin(), active.end(), [&rects, &rect](int other) {
+            return end(rects.at(other), true) < rect.x();
+        }), active.end());
+        for (int other : qAsConst(active)) {
+            const QRect &otherRect = rects.at(other);
+            if (touches(otherRect.y(), end(otherRect, false), rect.y(), end(rect, false))) {
+                pairs << qMakePair(other, index);
+            }
+        }
+        active << index;
+    }
+    return pairs;
+}
+
+// Pushes overlapping rects apart, the latter of two rightwards or downwards, whichever is less.
+void resolveOverlaps(QVector<QRect> &rects)
+{
+    for (int round = 0; round < maxRounds(rects.count()); ++round) {
+        bool moved = false;
+        const auto pairs = contacts(rects);
+        for (const auto &pair : pairs) {
+            const QRect &first = rects.at(pair.first);
+            QRect &second = rects[pair.second];
+            if (!first.intersects(second)) {
+                continue;
+            }
+            const int dx = end(first, true) - second.x();
+            const int dy = end(first, false) - second.y();
+            if (dx <= dy) {
+                second.translate(dx, 0);
+            } else {
+                second.translate(0, dy);
+            }
+            moved = true;
+        }
+        if (!moved) {
+            return;
+        }
+    }
+}
+
+// Labels the groups of rects which are connected by touching each other.
+QVector<int> components(const QVector<QRect> &rects)
+{
+    QVector<int> labels(rects.count());
+    std::iota(labels.begin(), labels.end(), 0);
+    auto find = [&labels](int index) {
+        while (labels.at(index) != index) {
+            index = labels[index] = labels.at(labels.at(index));
+        }
+        return index;
+    };
+
+    const auto pairs = contacts(rects);
+    for (const auto &pair : pairs) {
+        labels[find(pair.second)] = find(pair.first);
+    }
+    for (int i = 0; i < labels.count(); ++i) {
+        labels[i] = find(i);
+    }
+    return labels;
+}
+
+/**
+ * Moves each group of rects left or up until it touches a rect of another group, without
+ * passing any. With crossOnly, only rects facing the group across the other axis stop it,
+ * otherwise every rect before it along the axis does, which closes diagonal gaps.
+ * @returns whether a group moved
+ */
+bool pull(QVector<QRect> &rects, const QVector<int> &labels, bool horizontal, bool crossOnly)
+{
+    QHash<int, QVector<int>> groups;
+    for (int i = 0; i < rects.count(); ++i) {
+        groups[labels.at(i)] << i;
+    }
+    QVector<QVector<int>> ordered = groups.values().toVector();
+    auto groupStart = [&rects, horizontal](const QVector<int> &group) {
+        int value = std::numeric_limits<int>::max();
+        for (int index : group) {
+            value = qMin(value, start(rects.at(index), horizontal));
+        }
+        return value;
+    };
+    std::sort(ordered.begin(), ordered.end(), [&groupStart](const QVector<int> &a, const QVector<int> &b) {
+        const int startA = groupStart(a);
+        const int startB = groupStart(b);
+        return startA != startB ? startA < startB : a.first() < b.first();
+    });
+
+    bool moved = false;
+    for (const auto &group : qAsConst(ordered)) {
+        const int label = labels.at(group.first());
+        int shift = std::numeric_limits<int>::max();
+        for (int index : group) {
+            const QRect &rect = rects.at(index);
+            for (int other = 0; other < rects.count(); ++other) {
+                const QRect &otherRect = rects.at(other);
+                if (labels.at(other) == label || end(otherRect, horizontal) > start(rect, horizontal)) {
+                    continue;
+                }
+                if (crossOnly && !touches(start(otherRect, !horizontal), end(otherRect, !horizontal),
+                                          start(rect, !horizontal), end(rect, !horizontal))) {
+                    continue;
+                }
+                shift = qMin(shift, start(rect, horizontal) - end(otherRect, horizontal));
+            }
+        }
+        if (shift == std::numeric_limits<int>::max() || shift <= 0) {
+            // Nothing before it, or already touching.
+            continue;
+        }
+        for (int index : group) {
+            rects[index].translate(horizontal ? -shift : 0, horizontal ? 0 : -shift);
+        }
+        moved = true;
+    }
+    return moved;
+}
+
+// Moves the groups of touching rects together until they form one.
+void closeGaps(QVector<QRect> &rects)
+{
+    for (int round = 0; round < maxRounds(rects.count()); ++round) {
+        const QVector<int> labels = components(rects);
+        if (std::all_of(labels.cbegin(), labels.cend(), [&labels](int label) { return label == labels.first(); })) {
+            return;
+        }
+        bool moved = pull(rects, labels, true, true);
+        moved = pull(rects, components(rects), false, true) || moved;
+        if (!moved) {
+            // Only diagonal gaps are left, these are closed to a corner.
+            pull(rects, components(rects), true, false);
+        }
+    }
+}
+}
+
+QVector<QPoint> LayoutNormalizer::normalize(const QVector<QRect> &rects)
+{
+    // Empty rects take no space and are put at the origin.
+    QVector<int> indexes;
+    QVector<QRect> placed;
+    for (int i = 0; i < rects.count(); ++i) {
+        if (!rects.at(i).isEmpty()) {
+            indexes << i;
+            placed << rects.at(i);
+        }
+    }
+
+    resolveOverlaps(placed);
+    closeGaps(placed);
+
+    int left = std::numeric_limits<int>::max();
+    int top = std::numeric_limits<int>::max();
+    for (const auto &rect : qAsConst(placed)) {
+        left = qMin(left, rect.x());
+        top = qMin(top, rect.y());
+    }
+
+    QVector<QPoint> positions(rects.count());
+    for (int i = 0; i < indexes.count(); ++i) {
+        positions[indexes.at(i)] = placed.at(i).topLeft() - QPoint(left, top);
+    }
+    return positions;
+}
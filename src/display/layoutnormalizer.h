@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DDE_DISPLAY_LAYOUTNORMALIZER_H
+#define DDE_DISPLAY_LAYOUTNORMALIZER_H
+
+#include <QPoint>
+#include <QRect>
+#include <QVector>
+
+namespace dde {
+namespace display {
+
+namespace LayoutNormalizer
+{
+/**
+ * Moves the rects so that they touch without gaps or overlaps, with the top left corner of the
+ * layout at (0, 0). Overlapping rects are pushed apart, then groups of touching rects are moved
+ * left or up as a whole until they touch another group, so a layout without gaps or overlaps is
+ * only moved to the origin. Contacts are found by sweeping over the rects ordered by their left
+ * edge.
+ * @returns the new position of every rect, in the order of rects
+ */
+QVector<QPoint> normalize(const QVector<QRect> &rects);
+}
+
+}
+}
+
+#endif // DDE_DISPLAY_LAYOUTNORMALIZER_H
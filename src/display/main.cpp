@@ -4,14 +4,56 @@
 
 #include "display1adaptor.h"
 #include "display.h"
+#include "displaymanager.h"
 
+#include <QDebug>
 #include <QGuiApplication>
+#include <QMetaEnum>
+#include <QSocketNotifier>
 #include <DLog>
 
 #include <systemd/sd-daemon.h>
 
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 DCORE_USE_NAMESPACE
 
+// Written by the signal handler, read in the event loop.
+static int s_signalFds[2];
+
+static void handleQuitSignal(int)
+{
+    const char c = 1;
+    const ssize_t written = ::write(s_signalFds[0], &c, sizeof(c));
+    Q_UNUSED(written)
+}
+
+// SIGTERM, as sent by systemd on stop, and SIGINT end the event loop so aboutToQuit handlers run.
+static void installQuitSignalHandlers(QCoreApplication *app)
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalFds) != 0) {
+        qWarning() << "failed to create the signal socket pair";
+        return;
+    }
+    auto *notifier = new QSocketNotifier(s_signalFds[1], QSocketNotifier::Read, app);
+    QObject::connect(notifier, &QSocketNotifier::activated, app, [notifier]() {
+        notifier->setEnabled(false);
+        char c;
+        const ssize_t received = ::read(s_signalFds[1], &c, sizeof(c));
+        Q_UNUSED(received)
+        QCoreApplication::quit();
+    });
+
+    struct sigaction action = {};
+    action.sa_handler = handleQuitSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+}
+
 int main(int argc, char *argv[])
 {
     QGuiApplication app(argc, argv);
@@ -22,13 +64,23 @@ int main(int argc, char *argv[])
     DLogManager::registerConsoleAppender();
     DLogManager::registerFileAppender();
 
+    installQuitSignalHandlers(&app);
+
     Display1 *display = new Display1();
     new Display1Adaptor(display);
 
     QDBusConnection::sessionBus().registerService("org.deepin.dde.Display1");
     QDBusConnection::sessionBus().registerObject("/org/deepin/dde/Display1", "org.deepin.dde.Display1", display);
 
-    sd_notify(0, "READY=1");
+    // Callers waiting for the service get real monitors and screen sizes, not an empty state.
+    auto *manager = display->manager();
+    QObject::connect(manager, &dde::display::DisplayManager::startupStageReached, [](dde::display::DisplayManager::StartupStage stage) {
+        const char *name = QMetaEnum::fromType<dde::display::DisplayManager::StartupStage>().valueToKey(int(stage));
+        sd_notifyf(0, "STATUS=%s", name);
+    });
+    QObject::connect(manager, &dde::display::DisplayManager::ready, []() {
+        sd_notify(0, "READY=1");
+    });
 
     return app.exec();
 }
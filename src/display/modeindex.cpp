@@ -0,0 +1,153 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "modeindex.h"
+
+#include <algorithm>
+
+using namespace KScreen;
+using namespace dde::display;
+
+ModeIndex::ModeIndex(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ModeIndex::Key ModeIndex::key(const KScreen::ModePtr &mode)
+{
+    const QSize size = mode->size();
+    return Key { size.width(), size.height(), qRound(mode->refreshRate()) };
+}
+
+QVector<ModeIndex::Entry> ModeIndex::sortedModes(const KScreen::OutputPtr &output)
+{
+    QVector<Entry> entries;
+    const auto modes = output->modes();
+    entries.reserve(modes.count());
+    for (const auto &mode : modes) {
+        entries.append({ key(mode), mode });
+    }
+    // Of the modes sharing a key, the one with the highest exact refresh rate is kept.
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        if (!(a.key == b.key)) {
+            return a.key < b.key;
+        }
+        return a.mode->refreshRate() > b.mode->refreshRate();
+    });
+    entries.erase(std::unique(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        return a.key == b.key;
+    }), entries.end());
+    return entries;
+}
+
+ResolutionList ModeIndex::commonModes(const KScreen::ConfigPtr &config)
+{
+    if (!config) {
+        return ResolutionList();
+    }
+    // The same outputs may come with other modes, e.g. on another link, so the cached lists
+    // are only valid as long as the modes of all outputs are unchanged.
+    const auto outputs = config->connectedOutputs();
+    for (const auto &output : outputs) {
+        watchOutput(output);
+    }
+    const QString hash = config->connectedOutputsHash();
+    if (const auto *modes = m_commonModes.object(hash)) {
+        return *modes;
+    }
+
+    // Both lists are ordered by key, so each intersection is a single merge pass.
+    QVector<Entry> common;
+    bool first = true;
+    for (const auto &output : outputs) {
+        const auto modes = sortedModes(output);
+        if (first) {
+            common = modes;
+            first = false;
+            continue;
+        }
+        QVector<Entry> intersection;
+        auto a = common.cbegin();
+        auto b = modes.cbegin();
+        while (a != common.cend() && b != modes.cend()) {
+            if (a->key < b->key) {
+                ++a;
+            } else if (b->key < a->key) {
+                ++b;
+            } else {
+                intersection.append(*a);
+                ++a;
+                ++b;
+            }
+        }
+        common.swap(intersection);
+        if (common.isEmpty()) {
+            break;
+        }
+    }
+
+    // Modes are reported as those of the first output.
+    auto *list = new ResolutionList;
+    list->reserve(common.count());
+    for (const auto &entry : qAsConst(common)) {
+        list->append(Resolution(entry.mode->id().toInt(), entry.key.width, entry.key.height, entry.mode->refreshRate()));
+    }
+    const ResolutionList result = *list;
+    m_commonModes.insert(hash, list);
+    return result;
+}
+
+void ModeIndex::watchOutput(const KScreen::OutputPtr &output)
+{
+    const int outputId = output->id();
+    if (m_watchedOutputs.contains(outputId)) {
+        return;
+    }
+    m_watchedOutputs.insert(outputId);
+    connect(output.data(), &KScreen::Output::modesChanged, this, [this, outputId]() {
+        m_outputModes.remove(outputId);
+        m_commonModes.clear();
+    });
+    connect(output.data(), &QObject::destroyed, this, [this, outputId]() {
+        m_outputModes.remove(outputId);
+        m_watchedOutputs.remove(outputId);
+    });
+}
+
+const ModeIndex::OutputModes &ModeIndex::outputModes(const KScreen::OutputPtr &output)
+{
+    const int outputId = output->id();
+    const auto it = m_outputModes.constFind(outputId);
+    if (it != m_outputModes.constEnd()) {
+        return it.value();
+    }
+
+    watchOutput(output);
+    OutputModes &modes = m_outputModes[outputId];
+    const auto modeList = output->modes();
+    modes.byId.reserve(modeList.count());
+    for (const auto &mode : modeList) {
+        bool ok = false;
+        const uint id = mode->id().toUInt(&ok);
+        if (ok) {
+            modes.byId.insert(id, mode);
+        }
+        const auto size = qMakePair(mode->size().width(), mode->size().height());
+        const auto best = modes.bySize.constFind(size);
+        if (best == modes.bySize.constEnd() || best.value()->refreshRate() < mode->refreshRate()) {
+            modes.bySize.insert(size, mode);
+        }
+    }
+    return modes;
+}
+
+KScreen::ModePtr ModeIndex::mode(const KScreen::OutputPtr &output, uint modeId)
+{
+    return outputModes(output).byId.value(modeId);
+}
+
+KScreen::ModePtr ModeIndex::mode(const KScreen::OutputPtr &output, const QSize &size)
+{
+    return outputModes(output).bySize.value(qMakePair(size.width(), size.height()));
+}
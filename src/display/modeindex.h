@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DDE_DISPLAY_MODEINDEX_H
+#define DDE_DISPLAY_MODEINDEX_H
+
+#include "../dbus/resolutionlist.h"
+
+#include <kscreen/config.h>
+#include <kscreen/mode.h>
+#include <kscreen/output.h>
+
+#include <QCache>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+
+namespace dde {
+namespace display {
+
+/**
+ * Sorted views of the mode maps of outputs. Refresh rates are rounded to whole Hz, so modes at
+ * 59.94 and 60 Hz are the same for comparisons. Views are built on first use and dropped when
+ * the modes of an output change.
+ */
+class ModeIndex : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModeIndex(QObject *parent = nullptr);
+
+    struct Key {
+        int width;
+        int height;
+        int refresh;
+
+        // Larger sizes and rates come first.
+        bool operator<(const Key &other) const
+        {
+            if (width != other.width) {
+                return width > other.width;
+            }
+            if (height != other.height) {
+                return height > other.height;
+            }
+            return refresh > other.refresh;
+        }
+        bool operator==(const Key &other) const
+        {
+            return width == other.width && height == other.height && refresh == other.refresh;
+        }
+    };
+    struct Entry {
+        Key key;
+        KScreen::ModePtr mode;
+    };
+
+    static Key key(const KScreen::ModePtr &mode);
+    // Modes of output ordered by Key, with one entry per key.
+    static QVector<Entry> sortedModes(const KScreen::OutputPtr &output);
+
+    // Modes which all connected outputs of config support, cached by its connectedOutputsHash.
+    ResolutionList commonModes(const KScreen::ConfigPtr &config);
+
+    // Mode of output by its numeric id, and the mode with the highest refresh rate of a size.
+    KScreen::ModePtr mode(const KScreen::OutputPtr &output, uint modeId);
+    KScreen::ModePtr mode(const KScreen::OutputPtr &output, const QSize &size);
+
+private:
+    struct OutputModes {
+        QHash<uint, KScreen::ModePtr> byId;
+        QMap<QPair<int, int>, KScreen::ModePtr> bySize;
+    };
+    const OutputModes &outputModes(const KScreen::OutputPtr &output);
+    // Drops the views of output and all common modes once its modes change.
+    void watchOutput(const KScreen::OutputPtr &output);
+
+    QCache<QString, ResolutionList> m_commonModes { 16 };
+    QHash<int, OutputModes> m_outputModes;
+    // Outputs whose modesChanged signal is connected.
+    QSet<int> m_watchedOutputs;
+};
+
+}
+}
+
+#endif // DDE_DISPLAY_MODEINDEX_H
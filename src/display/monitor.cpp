@@ -3,10 +3,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "monitor.h"
+#include "displaymanager.h"
 
-Monitor::Monitor(const KScreen::OutputPtr &output, QObject *parent)
-    :QObject(parent)
+using namespace dde::display;
+
+Monitor::Monitor(const KScreen::OutputPtr &output, DisplayManager *manager)
+    :QObject(manager)
     ,m_monitor(output)
+    ,m_manager(manager)
 {
     registerResolutionMetaType();
     registerResolutionListMetaType();
@@ -14,6 +18,11 @@ Monitor::Monitor(const KScreen::OutputPtr &output, QObject *parent)
     registerReflectListMetaType();
 }
 
+void Monitor::setOutput(const KScreen::OutputPtr &output)
+{
+    m_monitor = output;
+}
+
 QString Monitor::name() const
 {
     return m_monitor->name();
@@ -36,7 +45,9 @@ short Monitor::y() const
 
 void Monitor::Enable(bool in0)
 {
-    m_monitor->setEnabled(in0);
+    if (auto *handler = m_manager->configHandler()) {
+        handler->setOutputEnabled(m_monitor, in0);
+    }
 }
 
 ushort Monitor::width() const
@@ -71,18 +82,40 @@ Resolution Monitor::currentMode() const
 
 void Monitor::SetMode(uint in0)
 {
-
+    const auto mode = m_manager->modeIndex()->mode(m_monitor, in0);
+    if (!mode) {
+        if (calledFromDBus()) {
+            sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("no mode with id %1").arg(in0));
+        }
+        return;
+    }
+    setMode(mode);
 }
 
 void Monitor::SetModeBySize(ushort in0, ushort in1)
 {
+    const auto mode = m_manager->modeIndex()->mode(m_monitor, QSize(in0, in1));
+    if (!mode) {
+        if (calledFromDBus()) {
+            sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("no mode of size %1x%2").arg(in0).arg(in1));
+        }
+        return;
+    }
+    setMode(mode);
+}
 
+void Monitor::setMode(const KScreen::ModePtr &mode)
+{
+    if (auto *handler = m_manager->configHandler()) {
+        handler->setOutputMode(m_monitor, mode->id());
+    }
 }
 
 void Monitor::SetPosition(short in0, short in1)
 {
-    QPoint pos(in0, in1);
-    m_monitor->setPos(pos);
+    if (auto *handler = m_manager->configHandler()) {
+        handler->setOutputPosition(m_monitor, QPoint(in0, in1));
+    }
 }
 
 void Monitor::SetReflect(ushort in0)
@@ -92,5 +125,21 @@ void Monitor::SetReflect(ushort in0)
 
 void Monitor::SetRotation(ushort in0)
 {
-
+    // The rotation values on dbus are the randr ones, which KScreen uses as well.
+    const auto rotation = static_cast<KScreen::Output::Rotation>(in0);
+    switch (rotation) {
+    case KScreen::Output::None:
+    case KScreen::Output::Left:
+    case KScreen::Output::Inverted:
+    case KScreen::Output::Right:
+        break;
+    default:
+        if (calledFromDBus()) {
+            sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("invalid rotation %1").arg(in0));
+        }
+        return;
+    }
+    if (auto *handler = m_manager->configHandler()) {
+        handler->setOutputRotation(m_monitor, rotation);
+    }
 }
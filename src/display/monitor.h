@@ -18,6 +18,12 @@
 
 #include <kscreen/output.h>
 
+namespace dde {
+namespace display {
+class DisplayManager;
+}
+} // namespace dde
+
 class Monitor : public QObject, public QDBusContext
 {
     Q_OBJECT
@@ -74,6 +80,8 @@ public :
     Resolution currentMode() const;
 
     void init();
+    // Points the object at output, which replaces the one it was created for.
+    void setOutput(const KScreen::OutputPtr &output);
 
 public Q_SLOTS:
     void Enable(bool in0);
@@ -84,11 +92,14 @@ public Q_SLOTS:
     void SetRotation(ushort in0);
 
 public:
-    Monitor(const KScreen::OutputPtr &output, QObject *parent = nullptr);
+    Monitor(const KScreen::OutputPtr &output, dde::display::DisplayManager *manager);
     ~Monitor() override=default;
 
 private:
+    void setMode(const KScreen::ModePtr &mode);
+
     KScreen::OutputPtr m_monitor;
+    dde::display::DisplayManager *m_manager;
 };
 
 #endif // DDE_DISPLAY_MONITOR_H
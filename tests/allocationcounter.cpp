@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "allocationcounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<bool> s_counting(false);
+static std::atomic<int> s_allocations(0);
+static std::atomic<qint64> s_bytes(0);
+
+extern "C" {
+// The allocator of glibc under its own name, the replacements below forward to it.
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+static void countAllocation(size_t size)
+{
+    if (s_counting) {
+        ++s_allocations;
+        s_bytes += qint64(size);
+    }
+}
+
+// Qt containers allocate through malloc and realloc directly, not through operator new.
+void *malloc(size_t size)
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+}
+
+void *operator new(std::size_t size)
+{
+    // Counted by malloc.
+    if (void *ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+namespace AllocationCounter
+{
+
+void start()
+{
+    s_allocations = 0;
+    s_bytes = 0;
+    s_counting = true;
+}
+
+void stop()
+{
+    s_counting = false;
+}
+
+int allocations()
+{
+    return s_allocations;
+}
+
+qint64 bytes()
+{
+    return s_bytes;
+}
+}
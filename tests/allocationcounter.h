@@ -0,0 +1,23 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef TESTS_ALLOCATIONCOUNTER_H
+#define TESTS_ALLOCATIONCOUNTER_H
+
+#include <QtGlobal>
+
+/**
+ * Counts the heap allocations made through operator new, malloc, calloc and realloc between
+ * start() and stop(), on any thread. Linking allocationcounter.cpp replaces these for the whole
+ * program, it relies on the __libc_* entry points of glibc.
+ */
+namespace AllocationCounter
+{
+void start();
+void stop();
+int allocations();
+qint64 bytes();
+}
+
+#endif // TESTS_ALLOCATIONCOUNTER_H
@@ -0,0 +1,168 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "allocationcounter.h"
+#include "display/configsnapshot.h"
+
+#include <kscreen/config.h>
+#include <kscreen/mode.h>
+#include <kscreen/output.h>
+
+#include <QtTest>
+
+using namespace dde::display;
+
+// Number of modes of each output, as exposed by monitors with many timings.
+static const int s_modeCount = 120;
+
+static KScreen::ConfigPtr createConfig(int outputCount)
+{
+    KScreen::OutputList outputs;
+    for (int i = 1; i <= outputCount; ++i) {
+        KScreen::ModeList modes;
+        for (int j = 0; j < s_modeCount; ++j) {
+            KScreen::ModePtr mode(new KScreen::Mode);
+            mode->setId(QString::number(i * 1000 + j));
+            mode->setName(QStringLiteral("%1x%2").arg(640 + j * 16).arg(480 + j * 9));
+            mode->setSize(QSize(640 + j * 16, 480 + j * 9));
+            mode->setRefreshRate(60.0 + j % 4 * 15);
+            modes.insert(mode->id(), mode);
+        }
+
+        KScreen::OutputPtr output(new KScreen::Output);
+        output->setId(i);
+        output->setName(QStringLiteral("DP-%1").arg(i));
+        output->setConnected(true);
+        output->setEnabled(true);
+        output->setModes(modes);
+        output->setCurrentModeId(modes.firstKey());
+        output->setPos(QPoint((i - 1) * 1920, 0));
+        outputs.insert(output->id(), output);
+    }
+    KScreen::ConfigPtr config(new KScreen::Config);
+    config->setOutputs(outputs);
+    return config;
+}
+
+class ConfigSnapshotBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void capture_data();
+    void capture();
+    void clone_data();
+    void clone();
+    void restore_data();
+    void restore();
+    void memory_data();
+    void memory();
+
+private:
+    void addOutputCounts();
+};
+
+void ConfigSnapshotBenchmark::addOutputCounts()
+{
+    QTest::addColumn<int>("outputCount");
+    for (int count : {1, 2, 4, 8}) {
+        QTest::addRow("%d outputs", count) << count;
+    }
+}
+
+void ConfigSnapshotBenchmark::capture_data()
+{
+    addOutputCounts();
+}
+
+void ConfigSnapshotBenchmark::capture()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+
+    ConfigSnapshot snapshot;
+    QBENCHMARK {
+        snapshot = ConfigSnapshot::capture(config);
+    }
+    QCOMPARE(snapshot.outputs.count(), outputCount);
+}
+
+void ConfigSnapshotBenchmark::clone_data()
+{
+    addOutputCounts();
+}
+
+// What keeping the initial and previous config cost before there were snapshots.
+void ConfigSnapshotBenchmark::clone()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+
+    KScreen::ConfigPtr clone;
+    QBENCHMARK {
+        clone = config->clone();
+    }
+    QCOMPARE(clone->outputs().count(), outputCount);
+}
+
+void ConfigSnapshotBenchmark::restore_data()
+{
+    addOutputCounts();
+}
+
+void ConfigSnapshotBenchmark::restore()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+    const ConfigSnapshot initial = ConfigSnapshot::capture(config);
+    for (const auto &output : config->outputs()) {
+        output->setPos(output->pos() + QPoint(0, 100));
+        output->setCurrentModeId(output->modes().lastKey());
+    }
+    const ConfigSnapshot changed = ConfigSnapshot::capture(config);
+
+    bool toInitial = true;
+    QBENCHMARK {
+        (toInitial ? initial : changed).restore(config);
+        toInitial = !toInitial;
+    }
+    QVERIFY(config->output(1)->pos() == QPoint(0, 0) || config->output(1)->pos() == QPoint(0, 100));
+}
+
+void ConfigSnapshotBenchmark::memory_data()
+{
+    addOutputCounts();
+}
+
+// Heap taken by a snapshot against a clone of the same config.
+void ConfigSnapshotBenchmark::memory()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+    // The identity tokens of the outputs are interned by the first capture.
+    ConfigSnapshot::capture(config);
+
+    AllocationCounter::start();
+    const ConfigSnapshot snapshot = ConfigSnapshot::capture(config);
+    AllocationCounter::stop();
+    const qint64 snapshotBytes = AllocationCounter::bytes();
+
+    AllocationCounter::start();
+    const KScreen::ConfigPtr clone = config->clone();
+    AllocationCounter::stop();
+    const qint64 cloneBytes = AllocationCounter::bytes();
+
+    qInfo("snapshot: %lld bytes, clone: %lld bytes", snapshotBytes, cloneBytes);
+    QCOMPARE(snapshot.outputs.count(), clone->outputs().count());
+    // The snapshot is its vector of outputs, the mode ids are shared with the config.
+    const qint64 outputsBytes = qint64(outputCount) * qint64(sizeof(OutputSnapshot));
+    QVERIFY(snapshotBytes >= outputsBytes);
+    QVERIFY(snapshotBytes < outputsBytes + 256);
+    // A clone copies every mode of every output.
+    QVERIFY(cloneBytes >= qint64(outputCount) * s_modeCount * qint64(sizeof(KScreen::Mode)));
+    QVERIFY(snapshotBytes * 10 < cloneBytes);
+}
+
+QTEST_GUILESS_MAIN(ConfigSnapshotBenchmark)
+
+#include "bench_configsnapshot.moc"
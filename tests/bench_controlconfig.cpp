@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "allocationcounter.h"
+#include "common/control.h"
+
+#include <kscreen/config.h>
+#include <kscreen/output.h>
+
+#include <QStandardPaths>
+#include <QtTest>
+
+// Connected outputs without EDID, their hash is derived from the connector name.
+static KScreen::ConfigPtr createConfig(int outputCount)
+{
+    KScreen::OutputList outputs;
+    for (int i = 1; i <= outputCount; ++i) {
+        KScreen::OutputPtr output(new KScreen::Output);
+        output->setId(i);
+        output->setName(QStringLiteral("DP-%1").arg(i));
+        output->setConnected(true);
+        output->setEnabled(true);
+        outputs.insert(output->id(), output);
+    }
+    KScreen::ConfigPtr config(new KScreen::Config);
+    config->setOutputs(outputs);
+    return config;
+}
+
+class ControlConfigBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void lookupGlobal_data();
+    void lookupGlobal();
+    void lookupIndividual_data();
+    void lookupIndividual();
+    void store_data();
+    void store();
+    void noAllocations_data();
+    void noAllocations();
+
+private:
+    void addOutputCounts();
+};
+
+void ControlConfigBenchmark::initTestCase()
+{
+    // Control files go to a throwaway location.
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void ControlConfigBenchmark::addOutputCounts()
+{
+    QTest::addColumn<int>("outputCount");
+    for (int count : {2, 4, 8, 16, 32, 64}) {
+        QTest::addRow("%d outputs", count) << count;
+    }
+}
+
+void ControlConfigBenchmark::lookupGlobal_data()
+{
+    addOutputCounts();
+}
+
+// The common case, the value comes from the control of the output itself.
+void ControlConfigBenchmark::lookupGlobal()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+    ControlConfig control(config);
+    const auto output = config->output(outputCount);
+    control.setOutputRetention(config->outputs().values(), Control::OutputRetention::Global);
+
+    qreal scale = 0;
+    QBENCHMARK {
+        scale += control.getScale(output);
+    }
+    QVERIFY(scale != 0);
+}
+
+void ControlConfigBenchmark::lookupIndividual_data()
+{
+    addOutputCounts();
+}
+
+// The value comes from the record of the output in the layout control file.
+void ControlConfigBenchmark::lookupIndividual()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+    ControlConfig control(config);
+    const auto output = config->output(outputCount);
+    control.setOutputRetention(config->outputs().values(), Control::OutputRetention::Individual);
+    control.setScale(output, 2);
+
+    qreal scale = 0;
+    QBENCHMARK {
+        scale += control.getScale(output);
+    }
+    QVERIFY(scale > 0);
+}
+
+void ControlConfigBenchmark::store_data()
+{
+    addOutputCounts();
+}
+
+void ControlConfigBenchmark::store()
+{
+    QFETCH(int, outputCount);
+    const auto config = createConfig(outputCount);
+    ControlConfig control(config);
+    const auto output = config->output(outputCount);
+
+    uint32_t overscan = 0;
+    QBENCHMARK {
+        control.setOverscan(output, ++overscan % 100);
+    }
+    QCOMPARE(control.getOverscan(output), overscan % 100);
+}
+
+void ControlConfigBenchmark::noAllocations_data()
+{
+    QTest::addColumn<Control::OutputRetention>("retention");
+    QTest::newRow("global") << Control::OutputRetention::Global;
+    QTest::newRow("individual") << Control::OutputRetention::Individual;
+}
+
+// Once the records exist, reading and writing values must not touch the heap.
+void ControlConfigBenchmark::noAllocations()
+{
+    QFETCH(Control::OutputRetention, retention);
+    const auto config = createConfig(8);
+    ControlConfig control(config);
+    const auto outputs = config->outputs().values();
+    control.setOutputRetention(outputs, retention);
+    for (const auto &output : outputs) {
+        control.setScale(output, 1);
+        control.setOverscan(output, 0);
+        control.setVrrPolicy(output, KScreen::Output::VrrPolicy::Never);
+    }
+
+    qreal scale = 0;
+    uint32_t overscan = 0;
+    int allocations = 0;
+    QBENCHMARK {
+        AllocationCounter::start();
+        for (const auto &output : outputs) {
+            control.setScale(output, 1.5);
+            scale += control.getScale(output);
+            control.setOverscan(output, overscan++ % 100);
+            overscan += control.getOverscan(output);
+            control.setVrrPolicy(output, KScreen::Output::VrrPolicy::Automatic);
+            scale += control.getAutoRotate(output) ? 1 : 0;
+            scale += control.getVrrPolicy(output) == KScreen::Output::VrrPolicy::Automatic ? 1 : 0;
+        }
+        AllocationCounter::stop();
+        allocations += AllocationCounter::allocations();
+    }
+    QCOMPARE(allocations, 0);
+    QVERIFY(scale > 0);
+}
+
+QTEST_GUILESS_MAIN(ControlConfigBenchmark)
+
+#include "bench_controlconfig.moc"
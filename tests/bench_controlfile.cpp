@@ -0,0 +1,187 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "common/control.h"
+#include "common/globals.h"
+
+#include <QCborMap>
+#include <QCborValue>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QJsonDocument>
+#include <QStandardPaths>
+#include <QtTest>
+
+// Layout control file as written for outputCount outputs with individual settings.
+static QVariantMap createLayoutInfo(int outputCount)
+{
+    QVariantList outputs;
+    for (int i = 0; i < outputCount; ++i) {
+        const QString id = QCryptographicHash::hash(QByteArray::number(i), QCryptographicHash::Md5).toHex();
+        outputs << QVariantMap{
+            {QStringLiteral("id"), id},
+            {QStringLiteral("metadata"), QVariantMap{{QStringLiteral("name"), QStringLiteral("DP-%1").arg(i)}}},
+            {QStringLiteral("retention"), 1},
+            {QStringLiteral("scale"), 1.25},
+            {QStringLiteral("autorotate"), true},
+            {QStringLiteral("autorotate-tablet-only"), false},
+            {QStringLiteral("replicate-hash"), i ? id : QString()},
+            {QStringLiteral("replicate-name"), i ? QStringLiteral("DP-0") : QString()},
+            {QStringLiteral("overscan"), 0u},
+            {QStringLiteral("vrrpolicy"), 2u},
+            {QStringLiteral("rgbrange"), 0u},
+        };
+    }
+    return QVariantMap{{QStringLiteral("outputs"), outputs}};
+}
+
+class ControlFileBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase();
+
+    void parseJson_data();
+    void parseJson();
+    void parseCbor_data();
+    void parseCbor();
+    void serializeJson_data();
+    void serializeJson();
+    void serializeCbor_data();
+    void serializeCbor();
+    void parseFile_data();
+    void parseFile();
+
+private:
+    void addOutputCounts();
+};
+
+void ControlFileBenchmark::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+}
+
+void ControlFileBenchmark::addOutputCounts()
+{
+    QTest::addColumn<int>("outputCount");
+    for (int count : {1, 2, 4, 8}) {
+        QTest::addRow("%d outputs", count) << count;
+    }
+}
+
+void ControlFileBenchmark::parseJson_data()
+{
+    addOutputCounts();
+}
+
+void ControlFileBenchmark::parseJson()
+{
+    QFETCH(int, outputCount);
+    const QByteArray data = QJsonDocument::fromVariant(createLayoutInfo(outputCount)).toJson();
+
+    QVariantMap info;
+    QBENCHMARK {
+        info = QJsonDocument::fromJson(data).toVariant().toMap();
+    }
+    QCOMPARE(info[QStringLiteral("outputs")].toList().count(), outputCount);
+}
+
+void ControlFileBenchmark::parseCbor_data()
+{
+    addOutputCounts();
+}
+
+void ControlFileBenchmark::parseCbor()
+{
+    QFETCH(int, outputCount);
+    const QByteArray data = QCborValue(QCborMap::fromVariantMap(createLayoutInfo(outputCount))).toCbor();
+
+    QVariantMap info;
+    QBENCHMARK {
+        info = QCborValue::fromCbor(data).toMap().toVariantMap();
+    }
+    QCOMPARE(info[QStringLiteral("outputs")].toList().count(), outputCount);
+}
+
+void ControlFileBenchmark::serializeJson_data()
+{
+    addOutputCounts();
+}
+
+void ControlFileBenchmark::serializeJson()
+{
+    QFETCH(int, outputCount);
+    const QVariantMap info = createLayoutInfo(outputCount);
+
+    QByteArray data;
+    QBENCHMARK {
+        data = QJsonDocument::fromVariant(info).toJson();
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void ControlFileBenchmark::serializeCbor_data()
+{
+    addOutputCounts();
+}
+
+void ControlFileBenchmark::serializeCbor()
+{
+    QFETCH(int, outputCount);
+    const QVariantMap info = createLayoutInfo(outputCount);
+
+    QByteArray data;
+    QBENCHMARK {
+        data = QCborValue(QCborMap::fromVariantMap(info)).toCbor();
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void ControlFileBenchmark::parseFile_data()
+{
+    QTest::addColumn<int>("outputCount");
+    QTest::addColumn<bool>("sidecar");
+    for (int count : {1, 2, 4, 8}) {
+        QTest::addRow("%d outputs, json", count) << count << false;
+        QTest::addRow("%d outputs, sidecar", count) << count << true;
+    }
+}
+
+// Parsing from disk as the daemon does it, including the check of the sidecar.
+void ControlFileBenchmark::parseFile()
+{
+    QFETCH(int, outputCount);
+    QFETCH(bool, sidecar);
+
+    const QString dir = Globals::dirPath() + QStringLiteral("control/configs/");
+    QVERIFY(QDir().mkpath(dir));
+    const QString path = dir + QStringLiteral("bench-%1").arg(outputCount);
+    QFile::remove(path + QStringLiteral(".cbor"));
+
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(QJsonDocument::fromVariant(createLayoutInfo(outputCount)).toJson());
+    // Sidecars are only written for files which settled, a modification time in the
+    // future keeps the json case from getting one halfway through.
+    const QDateTime modified = QDateTime::currentDateTime().addSecs(sidecar ? -3600 : 3600);
+    QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+    file.close();
+
+    if (sidecar) {
+        Control::parseFile(path);
+        QVERIFY(QFile::exists(path + QStringLiteral(".cbor")));
+    }
+
+    ControlFile controlFile;
+    QBENCHMARK {
+        controlFile = Control::parseFile(path);
+    }
+    QCOMPARE(QFile::exists(path + QStringLiteral(".cbor")), sidecar);
+    QCOMPARE(controlFile.info[QStringLiteral("outputs")].toList().count(), outputCount);
+}
+
+QTEST_GUILESS_MAIN(ControlFileBenchmark)
+
+#include "bench_controlfile.moc"
@@ -0,0 +1,149 @@
+// SPDX-FileCopyrightText: 2022 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "display/layoutnormalizer.h"
+
+#include <QRandomGenerator>
+#include <QtTest>
+
+#include <cmath>
+
+using namespace dde::display;
+
+static const QSize s_outputSize(1920, 1080);
+
+// A square video wall of outputCount outputs with gaps between them, the positions of the
+// outputs are moved by up to jitter pixels to get overlaps as well.
+static QVector<QRect> createWall(int outputCount, int jitter)
+{
+    const int columns = int(std::sqrt(outputCount));
+    QRandomGenerator random(outputCount);
+    QVector<QRect> rects;
+    rects.reserve(outputCount);
+    for (int i = 0; i < outputCount; ++i) {
+        const int dx = jitter ? random.bounded(-jitter, jitter) : 0;
+        const int dy = jitter ? random.bounded(-jitter, jitter) : 0;
+        const QPoint pos(100 + i % columns * (s_outputSize.width() + 80) + dx, 50 + i / columns * (s_outputSize.height() + 80) + dy);
+        rects << QRect(pos, s_outputSize);
+    }
+    return rects;
+}
+
+class LayoutNormalizerBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void normalize_data();
+    void normalize();
+    void keepsOffsets_data();
+    void keepsOffsets();
+
+private:
+    static void verifyPacked(const QVector<QRect> &rects, const QVector<QPoint> &positions);
+};
+
+void LayoutNormalizerBenchmark::normalize_data()
+{
+    QTest::addColumn<int>("outputCount");
+    QTest::addColumn<int>("jitter");
+    for (int count : {4, 16, 64}) {
+        QTest::addRow("%d outputs, grid", count) << count << 0;
+        QTest::addRow("%d outputs, jittered", count) << count << 120;
+    }
+}
+
+void LayoutNormalizerBenchmark::normalize()
+{
+    QFETCH(int, outputCount);
+    QFETCH(int, jitter);
+    const QVector<QRect> rects = createWall(outputCount, jitter);
+
+    QVector<QPoint> positions;
+    QBENCHMARK {
+        positions = LayoutNormalizer::normalize(rects);
+    }
+    verifyPacked(rects, positions);
+
+    // A packed layout is left as it is.
+    QVector<QRect> packed;
+    for (int i = 0; i < outputCount; ++i) {
+        packed << QRect(positions.at(i), rects.at(i).size());
+    }
+    QCOMPARE(LayoutNormalizer::normalize(packed), positions);
+
+    if (!jitter) {
+        // A regular wall packs into the exact grid.
+        const int columns = int(std::sqrt(outputCount));
+        for (int i = 0; i < outputCount; ++i) {
+            QCOMPARE(positions.at(i), QPoint(i % columns * s_outputSize.width(), i / columns * s_outputSize.height()));
+        }
+    }
+}
+
+void LayoutNormalizerBenchmark::keepsOffsets_data()
+{
+    QTest::addColumn<QVector<QRect>>("rects");
+    QTest::addColumn<QVector<QPoint>>("positions");
+    QTest::newRow("touching, offset")
+        << QVector<QRect>{ QRect(0, 0, 1920, 1080), QRect(1920, 200, 1280, 1024) }
+        << QVector<QPoint>{ QPoint(0, 0), QPoint(1920, 200) };
+    QTest::newRow("touching, away from origin")
+        << QVector<QRect>{ QRect(300, 500, 1920, 1080), QRect(300, 1580, 1920, 1080) }
+        << QVector<QPoint>{ QPoint(0, 0), QPoint(0, 1080) };
+    QTest::newRow("diagonal gap")
+        << QVector<QRect>{ QRect(0, 0, 1920, 1080), QRect(2500, 1500, 1920, 1080) }
+        << QVector<QPoint>{ QPoint(0, 0), QPoint(1920, 1080) };
+    QTest::newRow("gap below, offset")
+        << QVector<QRect>{ QRect(0, 0, 1920, 1080), QRect(600, 1300, 1920, 1080) }
+        << QVector<QPoint>{ QPoint(0, 0), QPoint(600, 1080) };
+}
+
+// Gaps are closed without changing the offsets on the other axis or the order of the outputs.
+void LayoutNormalizerBenchmark::keepsOffsets()
+{
+    QFETCH(QVector<QRect>, rects);
+    QFETCH(QVector<QPoint>, positions);
+    QCOMPARE(LayoutNormalizer::normalize(rects), positions);
+    verifyPacked(rects, positions);
+}
+
+// Checked pairwise, which is fine for a test.
+void LayoutNormalizerBenchmark::verifyPacked(const QVector<QRect> &rects, const QVector<QPoint> &positions)
+{
+    QCOMPARE(positions.count(), rects.count());
+    QVector<QRect> packed;
+    int left = std::numeric_limits<int>::max();
+    int top = std::numeric_limits<int>::max();
+    for (int i = 0; i < rects.count(); ++i) {
+        packed << QRect(positions.at(i), rects.at(i).size());
+        left = qMin(left, positions.at(i).x());
+        top = qMin(top, positions.at(i).y());
+    }
+    QCOMPARE(left, 0);
+    QCOMPARE(top, 0);
+    for (int i = 0; i < packed.count(); ++i) {
+        for (int j = i + 1; j < packed.count(); ++j) {
+            QVERIFY2(!packed.at(i).intersects(packed.at(j)), qPrintable(QStringLiteral("outputs %1 and %2 overlap").arg(i).arg(j)));
+        }
+    }
+
+    // No gaps, every output is reached from the first one over touching edges or corners.
+    QVector<bool> reached(packed.count(), false);
+    QVector<int> pending = { 0 };
+    reached[0] = true;
+    while (!pending.isEmpty()) {
+        const QRect touching = packed.at(pending.takeLast()).adjusted(-1, -1, 1, 1);
+        for (int i = 0; i < packed.count(); ++i) {
+            if (!reached.at(i) && touching.intersects(packed.at(i))) {
+                reached[i] = true;
+                pending << i;
+            }
+        }
+    }
+    QVERIFY2(!reached.contains(false), "outputs are not connected");
+}
+
+QTEST_GUILESS_MAIN(LayoutNormalizerBenchmark)
+
+#include "bench_layoutnormalizer.moc"